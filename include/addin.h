@@ -2,16 +2,202 @@
 // Copyright (c) KALX, LLC. All rights reserved. No warranty made.
 #pragma once
 #include <algorithm>
-#include <map>
+#include <cmath>
+#include <cwctype>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "auto.h"
 #include "register.h"
 
 namespace xll {
 
-	inline std::map<double, Args*>& RegIds()
-	{
-		static std::map<double, Args*> regids;
+	// Registered add-ins indexed by register id, function text and procedure.
+	// Names are case insensitive and a leading '=' or '?' is ignored, so the
+	// lower case procedure names Excel passes to xlAutoRegister12 match.
+	// Add-ins are inserted when registered and erased when unregistered,
+	// so looking up a name never needs xlfEvaluate. The values of constant
+	// functions are cached the first time they are evaluated.
+	class registry {
+		static wchar_t upper(wchar_t c) noexcept
+		{
+			return c < 0x80 ? (c >= L'a' && c <= L'z' ? c - (L'a' - L'A') : c) : static_cast<wchar_t>(std::towupper(c));
+		}
+		static std::wstring_view key(const XLOPER12& name) noexcept
+		{
+			auto k = view(name);
+			if (k.starts_with(L'=') || k.starts_with(L'?')) {
+				k.remove_prefix(1);
+			}
+
+			return k;
+		}
+		struct hash {
+			using is_transparent = void;
+			size_t operator()(std::wstring_view k) const noexcept
+			{
+				size_t h = 14695981039346656037ull; // FNV-1a
+				for (wchar_t c : k) {
+					h = (h ^ upper(c)) * 1099511628211ull;
+				}
+
+				return h;
+			}
+		};
+		struct equal {
+			using is_transparent = void;
+			bool operator()(std::wstring_view a, std::wstring_view b) const noexcept
+			{
+				return std::ranges::equal(a, b, {}, upper, upper);
+			}
+		};
+		template<class T>
+		using index = std::unordered_map<std::wstring, T, hash, equal>;
+
+		struct entry {
+			Args* args;
+			double regid;
+			std::optional<OPER> value; // =NAME() if constant
+		};
+		mutable std::shared_mutex mutex;
+		std::unordered_map<double, Args*> regids;
+		index<entry> texts;
+		index<Args*> procedures;
+	public:
+		static registry& instance()
+		{
+			static registry r;
+
+			return r;
+		}
+
+		// Functions with no arguments that are not volatile or uncalced and do not return handles.
+		static bool constant(const Args& args)
+		{
+			return args.macroType != 2 && xll::size(args.argumentType) == 0
+				&& view(args.typeText).find_first_of(L"!#") == std::wstring_view::npos
+				&& !view(args.functionText).starts_with(L'\\');
+		}
+
+		void insert(Args* pargs, double regid)
+		{
+			std::unique_lock lock(mutex);
+			regids.insert_or_assign(regid, pargs);
+			if (isStr(pargs->functionText)) {
+				texts.insert_or_assign(std::wstring(key(pargs->functionText)), entry{ pargs, regid, std::nullopt });
+			}
+			if (isStr(pargs->procedure)) {
+				procedures.insert_or_assign(std::wstring(key(pargs->procedure)), pargs);
+			}
+		}
+		// Erase the add-in with function text.
+		void erase(const XLOPER12& text)
+		{
+			if (!isStr(text)) {
+				return;
+			}
+			std::unique_lock lock(mutex);
+			if (auto i = texts.find(key(text)); i != texts.end()) {
+				if (auto j = procedures.find(key(i->second.args->procedure)); j != procedures.end()) {
+					procedures.erase(j);
+				}
+				regids.erase(i->second.regid);
+				texts.erase(i);
+			}
+		}
+
+		Args* find(double regid) const
+		{
+			std::shared_lock lock(mutex);
+			const auto i = regids.find(regid);
+
+			return i == regids.end() ? nullptr : i->second;
+		}
+		// Add-in with function text.
+		Args* find(const XLOPER12& text) const
+		{
+			if (isStr(text)) {
+				std::shared_lock lock(mutex);
+				if (auto i = texts.find(key(text)); i != texts.end()) {
+					return i->second.args;
+				}
+			}
+
+			return nullptr;
+		}
+		// Add-in with procedure name.
+		Args* procedure(const XLOPER12& name) const
+		{
+			if (isStr(name)) {
+				std::shared_lock lock(mutex);
+				if (auto i = procedures.find(key(name)); i != procedures.end()) {
+					return i->second;
+				}
+			}
+
+			return nullptr;
+		}
+		// Register id or NaN if text is not the function text of an add-in.
+		double regid(const XLOPER12& text) const
+		{
+			if (isStr(text)) {
+				std::shared_lock lock(mutex);
+				if (auto i = texts.find(key(text)); i != texts.end()) {
+					return i->second.regid;
+				}
+			}
+
+			return std::numeric_limits<double>::quiet_NaN();
+		}
+
+		// Cached value of =NAME().
+		std::optional<OPER> value(const XLOPER12& text) const
+		{
+			if (isStr(text)) {
+				std::shared_lock lock(mutex);
+				if (auto i = texts.find(key(text)); i != texts.end()) {
+					return i->second.value;
+				}
+			}
+
+			return std::nullopt;
+		}
+		// Remember the value of =NAME() if the add-in is constant.
+		void value(const XLOPER12& text, const OPER& v)
+		{
+			if (isStr(text) && !isErr(v)) {
+				std::unique_lock lock(mutex);
+				if (auto i = texts.find(key(text)); i != texts.end() && constant(*i->second.args)) {
+					i->second.value = v;
+				}
+			}
+		}
+
+		// Register ids and add-ins sorted by register id.
+		std::vector<std::pair<double, Args*>> ids() const
+		{
+			std::shared_lock lock(mutex);
+			std::vector<std::pair<double, Args*>> v(regids.begin(), regids.end());
+			std::ranges::sort(v, {}, &std::pair<double, Args*>::first);
 
-		return regids;
+			return v;
+		}
+		size_t size() const
+		{
+			std::shared_lock lock(mutex);
+
+			return regids.size();
+		}
+	};
+
+	// Snapshot of registered add-ins sorted by register id.
+	inline std::vector<std::pair<double, Args*>> RegIds()
+	{
+		return registry::instance().ids();
 	}
 
 	// Create add-in to be registered with Excel.
@@ -25,7 +211,7 @@ namespace xll {
 				try {
 					OPER regid = XlfRegister(&args);
 					if (regid.xltype == xltypeNum) {
-						RegIds()[regid.val.num] = &args;
+						registry::instance().insert(&args, regid.val.num);
 					}
 					else {
 						const auto err = OPER(L"AddIn: failed to register: ") & args.functionText;
@@ -58,7 +244,7 @@ namespace xll {
 
 						return FALSE;
 					}
-					RegIds().erase(Num(Excel(xlfEvaluate, text)));
+					registry::instance().erase(text);
 				}
 				catch (const std::exception& ex) {
 					XLL_ERROR(ex.what());
@@ -76,30 +262,16 @@ namespace xll {
 		}
 	public:
 		// Lookup using function text or register id.
-		static Args* find(const OPER& text)
+		static Args* find(const XLOPER12& text)
 		{
-			if (!isStr(text) && !isNum(text)) {
-				return nullptr;
-			}
-
-			Args* pargs = nullptr;
-			double regid = 0;
-
 			if (isStr(text)) {
-				regid = RegId(text);
-			}
-			else {
-				regid = Num(text);
+				return registry::instance().find(text);
 			}
-		
-			if (!isnan(regid)) {
-				const auto i = RegIds().find(regid);
-				if (i != RegIds().end()) {
-					pargs = i->second;
-				}
+			if (isNum(text)) {
+				return registry::instance().find(Num(text));
 			}
 
-			return pargs;
+			return nullptr;
 		}
 		
 		AddIn(const Args& args)
@@ -4,8 +4,14 @@
 #pragma once
 #include <string>
 #include <string_view>
+#ifdef _WIN32
 #include <windows.h>
 #include "XLCALL.H"
+#else
+#include <cstdio>
+#include "ref.h"
+#include "utf8.h"
+#endif
 
 enum xll_alert_level {
 	XLL_ALERT_ERROR = 1,
@@ -16,6 +22,7 @@ enum xll_alert_level {
 #define XLL_SUB_KEY "Software\\KALX\\xll"
 #define XLL_VALUE_NAME "AlertMask"
 
+#ifdef _WIN32
 inline int get_alert_mask() noexcept
 {
 	HKEY hkey{ 0 };
@@ -89,6 +96,43 @@ inline int XLL_ALERT(int level, std::wstring_view text,
 	return alert_level;
 }
 
+#else
+// No registry or message box. Keep the mask for the process and write alerts to stderr.
+inline int& alert_mask() noexcept
+{
+	static int mask = XLL_ALERT_ERROR | XLL_ALERT_WARNING | XLL_ALERT_INFORMATION;
+
+	return mask;
+}
+inline int get_alert_mask() noexcept
+{
+	return alert_mask();
+}
+inline void set_alert_mask(int level)
+{
+	alert_mask() = level;
+}
+
+inline int XLL_ALERT(int level, std::string_view text,
+	LPCSTR caption, UINT = 0, bool force = false)
+{
+	int alert_level = get_alert_mask();
+
+	if (force || (alert_level & level)) {
+		fprintf(stderr, "%s: %.*s\n", caption, static_cast<int>(text.size()), text.data());
+	}
+
+	return alert_level;
+}
+inline int XLL_ALERT(int level, std::wstring_view text,
+	const wchar_t* caption, UINT type = 0, bool force = false)
+{
+	return XLL_ALERT(level, utf8::wcstostring(text.data(), static_cast<int>(text.size())),
+		utf8::wcstostring(caption).c_str(), type, force);
+}
+
+#endif // _WIN32
+
 inline int XLL_ERROR(std::string_view text, bool force = false)
 {
 	return XLL_ALERT(XLL_ALERT_ERROR, text, "Error", MB_ICONERROR, force);
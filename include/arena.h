@@ -0,0 +1,159 @@
+// arena.h - per-thread bump allocator for results returned to Excel
+// Copyright (c) KALX, LLC. All rights reserved. No warranty made.
+// OPERs that live in the arena of their thread, the result of arena_oper
+// and its elements, allocate their strings and multis from it and never
+// free them individually. No other OPER uses the arena.
+// arena::release() is called by XLL.CALCULATION.ENDED and each arena
+// drops its memory in bulk when arena_oper is next called on its thread.
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+namespace xll {
+
+	class arena {
+		struct block {
+			block* next;
+			size_t size; // bytes following the block
+			size_t used;
+		};
+		block* head = nullptr;
+		size_t next_size = 1 << 16;
+		uint64_t epoch = 0;
+
+		inline static std::atomic<uint64_t> generation = 0;
+
+		// Arena of this thread once it is used.
+		static arena*& local_() noexcept
+		{
+			thread_local arena* p = nullptr;
+
+			return p;
+		}
+		static std::byte* data(block* b) noexcept
+		{
+			return reinterpret_cast<std::byte*>(b + 1);
+		}
+	public:
+		arena() = default;
+		arena(const arena&) = delete;
+		arena& operator=(const arena&) = delete;
+		~arena()
+		{
+			while (head) {
+				::operator delete(std::exchange(head, head->next));
+			}
+			if (local_() == this) {
+				local_() = nullptr;
+			}
+		}
+
+		// Arena of the calling thread.
+		static arena& local()
+		{
+			thread_local arena a;
+			local_() = &a;
+
+			return a;
+		}
+		// Arena of the calling thread if it holds p, otherwise nullptr.
+		static arena* of(const void* p) noexcept
+		{
+			arena* a = local_();
+
+			return a && a->holds(p) ? a : nullptr;
+		}
+		// Release the memory of every arena. Called when calculation ends.
+		static void release() noexcept
+		{
+			generation.fetch_add(1, std::memory_order_release);
+		}
+
+		void* allocate(size_t n, size_t align = alignof(std::max_align_t))
+		{
+			if (head) {
+				std::byte* p = data(head) + head->used;
+				const size_t pad = (0 - reinterpret_cast<uintptr_t>(p)) & (align - 1);
+				if (head->used + pad + n <= head->size) {
+					head->used += pad + n;
+
+					return p + pad;
+				}
+			}
+
+			const size_t size = (std::max)(next_size, n + align);
+			block* b = static_cast<block*>(::operator new(sizeof(block) + size));
+			*b = block{ head, size, 0 };
+			head = b;
+			next_size = 2 * size;
+
+			return allocate(n, align);
+		}
+
+		// p was handed out since the last reset.
+		bool holds(const void* p) const noexcept
+		{
+			const auto u = reinterpret_cast<uintptr_t>(p);
+			for (const block* b = head; b; b = b->next) {
+				const auto d = reinterpret_cast<uintptr_t>(b + 1);
+				if (d <= u && u < d + b->used) {
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		// Free all allocations. Blocks are coalesced so the next
+		// calculation fits in one block.
+		void reset() noexcept
+		{
+			if (head && head->next) {
+				size_t total = 0;
+				while (head) {
+					total += head->size;
+					::operator delete(std::exchange(head, head->next));
+				}
+				next_size = total;
+			}
+			else if (head) {
+				head->used = 0;
+			}
+			epoch = generation.load(std::memory_order_acquire);
+		}
+
+		// Reset if calculation ended since the last reset.
+		void refresh() noexcept
+		{
+			if (epoch != generation.load(std::memory_order_acquire)) {
+				reset();
+			}
+		}
+
+		// Bytes handed out since the last reset.
+		size_t used() const noexcept
+		{
+			size_t n = 0;
+			for (const block* b = head; b; b = b->next) {
+				n += b->used;
+			}
+
+			return n;
+		}
+		// Bytes held by the arena.
+		size_t capacity() const noexcept
+		{
+			size_t n = 0;
+			for (const block* b = head; b; b = b->next) {
+				n += b->size;
+			}
+
+			return n;
+		}
+	};
+
+} // namespace xll
@@ -220,6 +220,8 @@ X(documentation, xltypeStr,  "Documentation for the function.") \
 
 			return *this;
 		}
+		// Return LPOPER results with XLL_RESULT or arena_oper, not a static OPER.
+		// Excel does not allow thread-safe functions to be Uncalced.
 		Function& ThreadSafe()
 		{
 			typeText &= OPER(XLL_THREAD_SAFE);
@@ -16,6 +16,7 @@ namespace xll {
 	class Close {};       // functions to be called in xlAutoClose after Unregister
 	class Add {};
 	class Remove {};
+	class CalculationEnded {}; // functions to be called when Excel finishes or cancels calculating
 
 	// Register macros to be called in xlAuto functions.
 	template<class T>
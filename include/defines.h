@@ -93,11 +93,12 @@ namespace xll {
 		if (ret != xlretSuccess) {
 			return std::numeric_limits<double>::quiet_NaN();
 		}
-		if (!isNum(res)) {
-			return std::numeric_limits<double>::quiet_NaN();
+		const double regid = isNum(res) ? Num(res) : std::numeric_limits<double>::quiet_NaN();
+		if (isAlloc(res)) {
+			Excel12(xlFree, 0, 1, &res);
 		}
 
-		return Num(res);
+		return regid;
 	}
 } // namespace xll
 
@@ -1,8 +1,10 @@
 // enum.h - Functions used for enumerations.
 // Copyright (c) KALX, LLC. All rights reserved. No warranty made.
 #pragma once
+#include <cmath>
 #include <expected>
 #include "xloper.h"
+#include "addin.h"
 #include "handle.h"
 
 namespace xll
@@ -31,7 +33,7 @@ namespace xll
 	// String is name of a user defined function
 	inline bool isUDF(const XLOPER12& x)
 	{
-		return isStr(x) && RegIds().contains(RegId(x));
+		return isStr(x) && AddIn::find(x) != nullptr;
 	}
 	// UDF with no arguments
 	inline bool isEnum(const XLOPER12& x)
@@ -44,12 +46,17 @@ namespace xll
 		return false;
 	}
 
+	// Values of constant enumerations are cached after the first call.
 	inline OPER Eval(const XLOPER12& x)
 	{
 		OPER o = x;
 
 		if (isEnum(x)) {
+			if (auto v = registry::instance().value(x)) {
+				return *v;
+			}
 			o = Excel(xlfEvaluate, OPER(L"=") & OPER(x) & OPER(L"()"));
+			registry::instance().value(x, o);
 		}
 		else if (isFormula(x)) {
 			o = Excel(xlfEvaluate, x);
@@ -2,45 +2,99 @@
 // Copyright (c) KALX, LLC. All rights reserved. No warranty made.
 // https://xlladdins.github.io/Excel4Macros/
 #pragma once
-#include <array>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include "oper.h"
 
 namespace xll {
 
-	template<class... Ts>
-	inline OPER Excel(int fn, Ts&&... ts)
-	{
-		XLOPER12 res = { .xltype = xltypeNil };
+	// Result allocated by Excel and freed with xlFree when destroyed.
+	// Use Excel<xlfree>(...) to read a result without copying it into an OPER.
+	// Ownership is kept out of xltype so it can be passed back to Excel as an argument.
+	class xlfree : public XLOPER12 {
+		bool owned = false; // call xlFree
+	public:
+		xlfree() noexcept
+			: XLOPER12{ Nil }
+		{ }
+		// Adopt a result of Excel12v.
+		explicit xlfree(const XLOPER12& x) noexcept
+			: XLOPER12{ x }, owned{ isAlloc(x) }
+		{
+			xltype = type(x);
+		}
+		xlfree(const xlfree&) = delete;
+		xlfree& operator=(const xlfree&) = delete;
+		xlfree(xlfree&& x) noexcept
+			: XLOPER12{ x }, owned{ std::exchange(x.owned, false) }
+		{
+			x.xltype = xltypeNil;
+		}
+		xlfree& operator=(xlfree&& x) noexcept
+		{
+			if (this != &x) {
+				free();
+				static_cast<XLOPER12&>(*this) = x;
+				owned = std::exchange(x.owned, false);
+				x.xltype = xltypeNil;
+			}
 
-		std::array os{std::move(OPER(ts))...};
-		LPXLOPER12 pos[sizeof...(ts)]; // must be native XLOPER12
-		for (size_t i = 0; i < os.size(); ++i) {
-			pos[i] = &os[i];
+			return *this;
 		}
-		// Heap corruption if OPER address passed for res.
-		int ret = ::Excel12v(fn, &res, sizeof...(ts), &pos[0]);
-		ensure_ret(ret);
-		// ensure_err(res); // allow xltypeErr to be returned
-		OPER o(res);
-		if (isAlloc(res)) {
-			::Excel12(xlFree, 0, 1, &res);
+		~xlfree()
+		{
+			free();
 		}
 
-		return o;
-	}
-	
-	inline OPER Excel(int fn)
+		// Memory is owned by Excel.
+		bool owner() const noexcept
+		{
+			return owned;
+		}
+		void free() noexcept
+		{
+			if (owned) {
+				owned = false;
+				LPXLOPER12 px = this;
+				::Excel12v(xlFree, 0, 1, &px);
+			}
+			xltype = xltypeNil;
+		}
+	};
+
+	// XLOPER12 arguments are passed by pointer. Anything else is converted to an OPER.
+	template<class T>
+	using excel_arg = std::conditional_t<std::is_base_of_v<XLOPER12, std::remove_cvref_t<T>>, const XLOPER12&, OPER>;
+
+	template<class R = OPER, class... Ts>
+		requires std::is_same_v<R, OPER> || std::is_same_v<R, xlfree>
+	inline R Excel(int fn, Ts&&... ts)
 	{
-		XLOPER12 res = { .xltype = xltypeNil };
+		XLOPER12 res{};
+		res.xltype = xltypeNil;
 
-		const int ret = ::Excel12v(fn, &res, 0, nullptr);
+		std::tuple<excel_arg<Ts>...> os(std::forward<Ts>(ts)...);
+		LPXLOPER12 pos[sizeof...(ts) + 1]; // must be native XLOPER12
+		std::apply([&pos](const auto&... o) {
+			size_t i = 0;
+			((pos[i++] = const_cast<LPXLOPER12>(static_cast<const XLOPER12*>(&o))), ...);
+		}, os);
+		// Heap corruption if OPER address passed for res.
+		int ret = ::Excel12v(fn, &res, sizeof...(ts), &pos[0]);
 		ensure_ret(ret);
-		OPER o(res);
-		if (isAlloc(res)) {
-			::Excel12(xlFree, 0, 1, &res);
+		// ensure_err(res); // allow xltypeErr to be returned
+		if constexpr (std::is_same_v<R, xlfree>) {
+			return xlfree(res);
 		}
+		else {
+			OPER o(res);
+			if (isAlloc(res)) {
+				::Excel12(xlFree, 0, 1, &res);
+			}
 
-		return o;
+			return o;
+		}
 	}
-	
+
 } // namespace xll
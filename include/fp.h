@@ -3,11 +3,20 @@
 #pragma once
 #include <cstdint>
 #include <algorithm>
+#include <array>
+#include <functional>
 #include <initializer_list>
-//#include <mdspan>
+#include <iterator>
+#include <limits>
+#if __has_include(<mdspan>)
+#include <mdspan>
+#endif
 #include <span>
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
 #include "ensure.h"
+#include "ref.h"
 extern "C" {
 #include "fpx.h"
 }
@@ -62,16 +71,173 @@ namespace xll {
 	{
 		return std::span<const double>(array(a) + i * columns(a), columns(a));
 	}
-	/*
+
+	// Strided 2-D view of an array. Does not own or copy elements.
+	template<class T>
+	class fp_view {
+		T* a_;
+		int32_t rows_, columns_;
+		int32_t rs_, cs_; // row and column strides
+	public:
+		using value_type = std::remove_const_t<T>;
+
+		class iterator {
+			T* a_ = nullptr;
+			int32_t columns_ = 0, rs_ = 0, cs_ = 0;
+			int32_t i_ = 0, j_ = 0;
+		public:
+			using iterator_category = std::forward_iterator_tag;
+			using value_type = std::remove_const_t<T>;
+			using difference_type = std::ptrdiff_t;
+			using pointer = T*;
+			using reference = T&;
+
+			iterator() = default;
+			constexpr iterator(const fp_view& v, int32_t i) noexcept
+				: a_(v.a_), columns_(v.columns_), rs_(v.rs_), cs_(v.cs_), i_(i)
+			{ }
+			constexpr bool operator==(const iterator& k) const noexcept
+			{
+				return i_ == k.i_ && j_ == k.j_;
+			}
+			constexpr reference operator*() const noexcept
+			{
+				return a_[std::ptrdiff_t(i_) * rs_ + std::ptrdiff_t(j_) * cs_];
+			}
+			// row-major order
+			constexpr iterator& operator++() noexcept
+			{
+				if (++j_ == columns_) {
+					j_ = 0;
+					++i_;
+				}
+
+				return *this;
+			}
+			constexpr iterator operator++(int) noexcept
+			{
+				auto k = *this;
+				operator++();
+
+				return k;
+			}
+		};
+
+		constexpr fp_view(T* a, int32_t r, int32_t c, int32_t rs, int32_t cs) noexcept
+			: a_(a), rows_(r), columns_(c), rs_(rs), cs_(cs)
+		{ }
+		// Row-major r x c array.
+		constexpr fp_view(T* a, int32_t r, int32_t c) noexcept
+			: fp_view(a, r, c, c, 1)
+		{ }
+		constexpr operator fp_view<const T>() const noexcept
+			requires (!std::is_const_v<T>)
+		{
+			return fp_view<const T>(a_, rows_, columns_, rs_, cs_);
+		}
+
+		constexpr int32_t rows() const noexcept
+		{
+			return rows_;
+		}
+		constexpr int32_t columns() const noexcept
+		{
+			return columns_;
+		}
+		constexpr int32_t size() const noexcept
+		{
+			return rows_ * columns_;
+		}
+		constexpr int32_t row_stride() const noexcept
+		{
+			return rs_;
+		}
+		constexpr int32_t column_stride() const noexcept
+		{
+			return cs_;
+		}
+		constexpr T* data() const noexcept
+		{
+			return a_;
+		}
+		// Elements of each row are adjacent.
+		constexpr bool row_contiguous() const noexcept
+		{
+			return cs_ == 1 || columns_ <= 1;
+		}
+
+		constexpr T& operator()(int32_t i, int32_t j) const noexcept
+		{
+			return a_[std::ptrdiff_t(i) * rs_ + std::ptrdiff_t(j) * cs_];
+		}
+		// Row-major index.
+		constexpr T& operator[](int32_t k) const noexcept
+		{
+			return operator()(k / columns_, k % columns_);
+		}
+
+		constexpr iterator begin() const noexcept
+		{
+			return iterator(*this, 0);
+		}
+		constexpr iterator end() const noexcept
+		{
+			return iterator(*this, columns_ ? rows_ : 0);
+		}
+
+		constexpr fp_view row(int32_t i) const noexcept
+		{
+			return fp_view(&operator()(i, 0), 1, columns_, rs_, cs_);
+		}
+		constexpr fp_view column(int32_t j) const noexcept
+		{
+			return fp_view(&operator()(0, j), rows_, 1, rs_, cs_);
+		}
+		// r x c block with top left corner at (i, j).
+		constexpr fp_view block(int32_t i, int32_t j, int32_t r, int32_t c) const noexcept
+		{
+			return fp_view(&operator()(i, j), r, c, rs_, cs_);
+		}
+		constexpr fp_view transpose() const noexcept
+		{
+			return fp_view(a_, columns_, rows_, cs_, rs_);
+		}
+#ifdef __cpp_lib_mdspan
+		constexpr auto mdspan() const noexcept
+		{
+			using E = std::dextents<int32_t, 2>;
+
+			return std::mdspan(a_, std::layout_stride::mapping(E(rows_, columns_), std::array<int32_t, 2>{ rs_, cs_ }));
+		}
+#endif
+	};
+
+	constexpr auto view(_FP12& a) noexcept
+	{
+		return fp_view<double>(array(a), rows(a), columns(a));
+	}
+	constexpr auto view(const _FP12& a) noexcept
+	{
+		return fp_view<const double>(array(a), rows(a), columns(a));
+	}
+
 	constexpr auto column(_FP12& a, int32_t j) noexcept
 	{
-		return std::mdspan<double>(array(a) + j, rows(a));
+		return view(a).column(j);
 	}
 	constexpr auto column(const _FP12& a, int32_t j) noexcept
 	{
-		return std::mdspan<const double>(array(a) + j, rows(a));
+		return view(a).column(j);
+	}
+	constexpr auto block(_FP12& a, int32_t i, int32_t j, int32_t r, int32_t c) noexcept
+	{
+		return view(a).block(i, j, r, c);
 	}
-	*/
+	constexpr auto block(const _FP12& a, int32_t i, int32_t j, int32_t r, int32_t c) noexcept
+	{
+		return view(a).block(i, j, r, c);
+	}
+
 	constexpr double* begin(_FP12& a) noexcept
 	{
 		return array(a);
@@ -96,11 +262,103 @@ namespace xll {
 		return x;
 	}
 
+	// Vector kernels dispatched on the CPU at runtime. See src/fpx_simd.c.
+	inline double sum(const _FP12& a) noexcept
+	{
+		return fpx_sum(array(a), size(a));
+	}
+	// Sum contiguous rows with the kernel.
+	inline double sum(fp_view<const double> v) noexcept
+	{
+		double s = 0;
+
+		if (v.columns() > 1 && v.row_contiguous()) {
+			for (int32_t i = 0; i < v.rows(); ++i) {
+				s += fpx_sum(&v(i, 0), v.columns());
+			}
+		}
+		else {
+			for (double x : v) {
+				s += x;
+			}
+		}
+
+		return s;
+	}
+	inline double dot(const _FP12& a, const _FP12& b)
+	{
+		ensure(size(a) == size(b));
+
+		return fpx_dot(array(a), array(b), size(a));
+	}
+	// Infinity if empty.
+	inline double minimum(const _FP12& a) noexcept
+	{
+		return fpx_min(array(a), size(a));
+	}
+	// -Infinity if empty.
+	inline double maximum(const _FP12& a) noexcept
+	{
+		return fpx_max(array(a), size(a));
+	}
+	// x = a x
+	inline _FP12& scale(double a, _FP12& x) noexcept
+	{
+		fpx_scale(a, array(x), size(x));
+
+		return x;
+	}
+	// y = a x + y
+	inline _FP12& axpy(double a, const _FP12& x, _FP12& y)
+	{
+		ensure(size(x) == size(y));
+		fpx_axpy(a, array(x), array(y), size(y));
+
+		return y;
+	}
+	// Elementwise y = y op x
+	inline _FP12& add(const _FP12& x, _FP12& y)
+	{
+		ensure(size(x) == size(y));
+		fpx_add(array(x), array(y), size(y));
+
+		return y;
+	}
+	inline _FP12& sub(const _FP12& x, _FP12& y)
+	{
+		ensure(size(x) == size(y));
+		fpx_sub(array(x), array(y), size(y));
+
+		return y;
+	}
+	inline _FP12& mul(const _FP12& x, _FP12& y)
+	{
+		ensure(size(x) == size(y));
+		fpx_mul(array(x), array(y), size(y));
+
+		return y;
+	}
+	inline _FP12& div(const _FP12& x, _FP12& y)
+	{
+		ensure(size(x) == size(y));
+		fpx_div(array(x), array(y), size(y));
+
+		return y;
+	}
+	// In-place running sum in row-major order.
+	inline _FP12& cumsum(_FP12& a) noexcept
+	{
+		fpx_cumsum(array(a), size(a));
+
+		return a;
+	}
+
 	class FPX {
 		struct fpx* fpx_;
+		int32_t capacity_; // number of doubles fpx_ can hold
 	public:
 		FPX(int32_t r = 0, int32_t c = 0)
-			: fpx_(fpx_malloc(r, c))
+			: fpx_(fpx_malloc(r, c)), capacity_(r * c)
 		{
 			ensure(fpx_);
 		}
@@ -128,6 +386,7 @@ namespace xll {
 		template<class I>
 			requires std::is_same_v<double, std::iter_value_t<I>>
 		FPX(I i)
+			: FPX()
 		{
 			while (i) {
 				append(*i);
@@ -135,25 +394,39 @@ namespace xll {
 			}
 		}
 		FPX(FPX&& a) noexcept
-			: fpx_(a.fpx_)
-		{
-			a.fpx_ = nullptr;
-		}
+			: fpx_(std::exchange(a.fpx_, nullptr)), capacity_(std::exchange(a.capacity_, 0))
+		{ }
 		FPX& operator=(const FPX& a)
 		{
 			if (this != &a) {
-				fpx_free(fpx_);
-				fpx_ = fpx_malloc(a.rows(), a.columns());
-				std::copy_n(a.array(), a.size(), fpx_->array);
+				if (a.fpx_) {
+					operator=(static_cast<const _FP12&>(a));
+				}
+				else {
+					resize(0, 0);
+				}
 			}
 
 			return *this;
 		}
+		// Reuses the current allocation if it is large enough.
 		FPX& operator=(const _FP12& a)
 		{
-			fpx_free(fpx_);
-			fpx_ = fpx_malloc(a.rows, a.columns);
-			std::copy_n(a.array, xll::size(a), fpx_->array);
+			int32_t n = xll::size(a);
+
+			if (fpx_ && n <= capacity_) {
+				std::copy_n(a.array, n, fpx_->array);
+				fpx_->rows = a.rows;
+				fpx_->columns = a.columns;
+			}
+			else {
+				auto _fpx = fpx_malloc(a.rows, a.columns);
+				ensure(_fpx);
+				std::copy_n(a.array, n, _fpx->array);
+				fpx_free(fpx_);
+				fpx_ = _fpx;
+				capacity_ = n;
+			}
 
 			return *this;
 		}
@@ -162,6 +435,7 @@ namespace xll {
 			if (this != &a) {
 				fpx_free(fpx_);
 				fpx_ = std::exchange(a.fpx_, nullptr);
+				capacity_ = std::exchange(a.capacity_, 0);
 			}
 
 			return *this;
@@ -183,6 +457,11 @@ namespace xll {
 		{
 			return rows() * columns();
 		}
+		// Number of elements that fit without reallocating.
+		int32_t capacity() const noexcept
+		{
+			return capacity_;
+		}
 		double* array() noexcept
 		{
 			return (size() && fpx_) ? fpx_->array : nullptr;
@@ -227,31 +506,42 @@ namespace xll {
 			return xll::index(*get(), i, j);
 		}
 
-		FPX& resize(int32_t r, int32_t c)
+		// Make room for at least n elements without changing the shape.
+		FPX& reserve(int32_t n)
 		{
-			if (r * c != size()) {
-				auto _fpx = fpx_realloc(fpx_, r, c);
+			if (!fpx_ || n > capacity_) {
+				auto _fpx = fpx_reserve(fpx_, n);
 				ensure(_fpx);
 				fpx_ = _fpx;
+				capacity_ = n;
 			}
-			else {
-				fpx_->rows = r;
-				fpx_->columns = c;
-			}
 
 			return *this;
 		}
 
-		FPX& swap(FPX& a)
+		// Elements past the old size are not initialized.
+		FPX& resize(int32_t r, int32_t c)
+		{
+			grow(r * c);
+			fpx_->rows = r;
+			fpx_->columns = c;
+
+			return *this;
+		}
+
+		FPX& swap(FPX& a) noexcept
 		{
 			std::swap(fpx_, a.fpx_);
+			std::swap(capacity_, a.capacity_);
 
 			return *this;
 		}
 
 		FPX& transpose()
 		{
-			xll::transpose(*get());
+			if (fpx_) {
+				fpx_transpose(fpx_);
+			}
 
 			return *this;
 		}
@@ -261,19 +551,22 @@ namespace xll {
 			if (size() == 0) {
 				operator=(a);
 			}
+			else if (contains(a)) {
+				vstack(FPX(a));
+			}
 			else {
 				ensure(columns() == a.columns);
 
 				int32_t n = size();
 				resize(rows() + a.rows, columns());
-				std::copy_n(a.array, a.rows * a.columns, fpx_->array + n);
+				std::copy_n(a.array, xll::size(a), fpx_->array + n);
 			}
 
 			return *this;
 		}
 		FPX& vstack(const FPX& a)
 		{
-			return vstack(*a.get());
+			return a.size() ? vstack(*a.get()) : *this;
 		}
 
 		FPX& hstack(const _FP12& a)
@@ -281,22 +574,27 @@ namespace xll {
 			if (size() == 0) {
 				operator=(a);
 			}
+			else if (contains(a)) {
+				hstack(FPX(a));
+			}
 			else {
-				// !!! not efficient
-				FPX a_(*this);
-				a_.transpose();
-				FPX _a(a);
-				_a.transpose();
-				a_.vstack(_a);
-				a_.transpose();
-				swap(a_);
+				ensure(rows() == a.rows);
+
+				int32_t c = columns();
+				int32_t c_ = c + a.columns;
+				resize(rows(), c_);
+				// spread rows from the last one down
+				for (int32_t i = rows() - 1; i >= 0; --i) {
+					std::copy_backward(fpx_->array + i * c, fpx_->array + (i + 1) * c, fpx_->array + i * c_ + c);
+					std::copy_n(a.array + i * a.columns, a.columns, fpx_->array + i * c_ + c);
+				}
 			}
 
 			return *this;
 		}
 		FPX& hstack(const FPX& a)
 		{
-			return hstack(*a.get());
+			return a.size() ? hstack(*a.get()) : *this;
 		}
 
 		// Only works for vector arrays
@@ -307,24 +605,54 @@ namespace xll {
 
 			if (n == 0) {
 				resize(1, 1);
-				operator[](0) = x;
 			}
 			else if (rows() == 1) {
 				resize(1, n + 1);
-				operator[](n) = x;
 			}
 			else {
 				resize(n + 1, 1);
-				operator[](n) = x;
 			}
+			operator[](n) = x;
 
 			return *this;
 		}
+	private:
+		// Geometric growth to hold at least n elements.
+		void grow(int32_t n)
+		{
+			if (!fpx_ || n > capacity_) {
+				reserve((std::max)(n, capacity_ < INT32_MAX / 2 ? 2 * capacity_ : INT32_MAX));
+			}
+		}
+		// True if a points into our allocation.
+		bool contains(const _FP12& a) const noexcept
+		{
+			const double* p = a.array;
 
+			return fpx_ && std::less_equal<const double*>{}(fpx_->array, p)
+				&& std::less<const double*>{}(p, fpx_->array + capacity_);
+		}
 	};
 
 	using FP12 = FPX;
 
+	// Column of row sums.
+	inline FPX row_sums(const _FP12& a)
+	{
+		FPX s(rows(a), 1);
+		fpx_row_sums(rows(a), columns(a), array(a), s.array());
+
+		return s;
+	}
+	// Row of column sums.
+	inline FPX column_sums(const _FP12& a)
+	{
+		FPX s(1, columns(a));
+		fpx_column_sums(rows(a), columns(a), array(a), s.array());
+
+		return s;
+	}
+
 	// Fixed size array.
 	template<int32_t N, int32_t M>
 	struct fp12 {
@@ -35,9 +35,36 @@ inline int32_t fpx_size(struct fpx* fpx)
 
 // Row-major order
 extern int32_t fpx_index(struct fpx* fpx, int32_t i, int32_t j);
+// array is 64 byte aligned, free with fpx_free
 struct fpx* fpx_malloc(int32_t r, int32_t c);
 struct fpx* fpx_realloc(struct fpx* fpx, int32_t r, int32_t c);
+// reallocate to hold at least n elements keeping rows and columns
+struct fpx* fpx_reserve(struct fpx* fpx, int32_t n);
 void fpx_free(struct fpx*);
 // in-place transpose
 struct fpx* fpx_transpose(struct fpx* fpx);
+// b = transpose of r x c array a, b must not overlap a
+void fpx_transpose_copy(int32_t r, int32_t c, const double* a, double* b);
 
+// Vector kernels with runtime CPU dispatch. See fpx_simd.c.
+// Set the kernel level to at most 0 scalar, 1 AVX2, 2 AVX-512 and return the level in use.
+// Use a negative level to only query.
+int fpx_simd(int level);
+double fpx_sum(const double* a, int32_t n);
+double fpx_dot(const double* a, const double* b, int32_t n);
+double fpx_min(const double* a, int32_t n);
+double fpx_max(const double* a, int32_t n);
+// y = a*x + y
+void fpx_axpy(double a, const double* x, double* y, int32_t n);
+// x = a*x
+void fpx_scale(double a, double* x, int32_t n);
+// y = y op x
+void fpx_add(const double* x, double* y, int32_t n);
+void fpx_sub(const double* x, double* y, int32_t n);
+void fpx_mul(const double* x, double* y, int32_t n);
+void fpx_div(const double* x, double* y, int32_t n);
+// in-place running sum
+void fpx_cumsum(double* a, int32_t n);
+// s[i] = sum of row i, s[j] = sum of column j
+void fpx_row_sums(int32_t r, int32_t c, const double* a, double* s);
+void fpx_column_sums(int32_t r, int32_t c, const double* a, double* s);
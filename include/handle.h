@@ -3,13 +3,26 @@
 // A handle<T> acts much like a std::unique_ptr<T> but is owned by the cell it is created in.
 // The 64-bits of the pointer are cast to a double and returned to Excel as a funny looking number.
 // In Windows the first 16 bits of a pointer are always 0 so the double is an exact integer.
+// A handle<T, handle_slots<T>> is a slot index and generation instead of pointer bits.
 #pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <functional>
 #include <limits>
-#include <map>
 #include <memory>
-#include <set>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
 #include <typeinfo>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
+#include <vector>
 #include "excel.h"
 
 // handle data type
@@ -45,11 +58,39 @@ namespace xll {
 	template<class T>
 	inline T* to_pointer(HANDLEX h)
 	{
+		// also NaN and infinities
+		if (!(h >= 0 && h < 0x1p53)) {
+			return nullptr;
+		}
+
 		return reinterpret_cast<T*>(static_cast<uintptr_t>(h));
 	}
 
+	// Concurrent set of pointers. Lookups take a shared lock.
+	class pointer_set {
+		mutable std::shared_mutex m;
+		std::unordered_set<const void*> s;
+	public:
+		void insert(const void* p)
+		{
+			std::unique_lock lock(m);
+			s.insert(p);
+		}
+		void erase(const void* p)
+		{
+			std::unique_lock lock(m);
+			s.erase(p);
+		}
+		bool contains(const void* p) const
+		{
+			std::shared_lock lock(m);
+
+			return s.contains(p);
+		}
+	};
+
 	// keep track of handles returned to Excel
-	inline std::set<void*> safe_pointers;
+	inline pointer_set safe_pointers;
 
 	template<class T>
 	inline HANDLEX safe_handle(T* p)
@@ -76,29 +117,811 @@ namespace xll {
 	}
 
 	// typeid<T>.name() given pointer
-	inline std::map<void*, const char*> handle_typename;
+	class typename_map {
+		mutable std::shared_mutex m;
+		std::unordered_map<const void*, const char*> map;
+		std::vector<const void*(*)(HANDLEX)> decoders; // one for each handle table
+	public:
+		// Add the decoder of a handle table.
+		void add(const void*(*decode)(HANDLEX))
+		{
+			std::unique_lock lock(m);
+			decoders.push_back(decode);
+		}
+		void insert(const void* p, const char* name)
+		{
+			std::unique_lock lock(m);
+			map[p] = name;
+		}
+		void erase(const void* p)
+		{
+			std::unique_lock lock(m);
+			map.erase(p);
+		}
+		// nullptr if not found
+		const char* find(const void* p) const
+		{
+			std::shared_lock lock(m);
+			const auto i = map.find(p);
+
+			return i == map.end() ? nullptr : i->second;
+		}
+		// Name of the object of a live handle of any type or nullptr.
+		const char* find(HANDLEX h) const
+		{
+			std::shared_lock lock(m);
+			for (const auto decode : decoders) {
+				if (const void* p = decode(h)) {
+					if (const auto i = map.find(p); i != map.end()) {
+						return i->second;
+					}
+				}
+			}
+
+			return nullptr;
+		}
+	};
+	inline typename_map handle_typename;
+
+	// Calling cell of handles created or looked up on this thread.
+	// Without a scope every handle calls xlfCaller. Put a caller_scope at the
+	// top of a function using several handles to call it at most once.
+	// caller_scope(false) also skips detecting temporary handles created
+	// by an argument in the same cell. Use it in functions that only look up
+	// handles and never take nested handle-creating calls as arguments.
+	class caller_scope {
+		OPER cell; // Nil until needed
+		bool temporaries;
+		caller_scope* prev;
+
+		static caller_scope*& current() noexcept
+		{
+			thread_local caller_scope* p = nullptr;
+
+			return p;
+		}
+	public:
+		caller_scope(bool temporaries = true) noexcept
+			: temporaries(temporaries), prev(std::exchange(current(), this))
+		{ }
+		caller_scope(const caller_scope&) = delete;
+		caller_scope& operator=(const caller_scope&) = delete;
+		~caller_scope()
+		{
+			current() = prev;
+		}
+
+		// Calling cell of the function running on this thread.
+		static const OPER& caller()
+		{
+			caller_scope* s = current();
+			if (!s) {
+				thread_local OPER cell;
+				cell = Excel(xlfCaller);
+
+				return cell;
+			}
+			if (s->cell.xltype == xltypeNil) {
+				s->cell = Excel(xlfCaller);
+			}
+
+			return s->cell;
+		}
+		// Lookups check for temporary handles.
+		static bool check_temporaries() noexcept
+		{
+			const caller_scope* s = current();
 
-	// compare underlying raw pointers
+			return !s || s->temporaries;
+		}
+	};
+
+	// Storage for objects of type T in slabs. Freed storage is reused first
+	// so objects created and deleted on every recalc stay off the global heap
+	// and objects of one type are close together.
 	template<class T>
-	struct unique_ptrcmp {
-		using is_transparent = void;
+	class object_pool {
+		union node {
+			node* next;
+			alignas(T) std::byte data[sizeof(T)];
+		};
+		std::mutex m;
+		std::vector<std::unique_ptr<node[]>> slabs;
+		node* free = nullptr;
+		size_t next_size = 16;
+		size_t live = 0;
 
-		template<class T>
-		bool operator()(const std::unique_ptr<T>& a, const T* b) const
+		object_pool() = default;
+	public:
+		object_pool(const object_pool&) = delete;
+		object_pool& operator=(const object_pool&) = delete;
+
+		// Never destroyed since handles in static tables may outlive it.
+		static object_pool& instance()
 		{
-			return a.get() < b;
+			static object_pool* p = new object_pool;
+
+			return *p;
 		}
 
-		template<class T>
-		bool operator()(const T* a, const std::unique_ptr<T>& b) const
+		void* allocate()
+		{
+			std::lock_guard lock(m);
+			if (!free) {
+				auto& slab = slabs.emplace_back(new node[next_size]);
+				for (size_t i = next_size; i-- > 0; ) {
+					slab[i].next = std::exchange(free, &slab[i]);
+				}
+				next_size *= 2;
+			}
+			++live;
+
+			return std::exchange(free, free->next);
+		}
+		void deallocate(void* p) noexcept
 		{
-			return a < b.get();
+			std::lock_guard lock(m);
+			static_cast<node*>(p)->next = std::exchange(free, static_cast<node*>(p));
+			--live;
 		}
 
+		template<class... Args>
+		T* construct(Args&&... args)
+		{
+			void* p = allocate();
+			try {
+				return ::new(p) T(std::forward<Args>(args)...);
+			}
+			catch (...) {
+				deallocate(p);
+				throw;
+			}
+		}
+		void destroy(T* p) noexcept
+		{
+			p->~T();
+			deallocate(p);
+		}
+
+		// Number of objects allocated.
+		size_t size()
+		{
+			std::lock_guard lock(m);
+
+			return live;
+		}
+		// Number of objects the slabs hold.
+		size_t capacity()
+		{
+			std::lock_guard lock(m);
+
+			return next_size - 16;
+		}
+	};
+
+	// Owner of an object in a handle table, deleted or returned to its pool.
+	template<class T>
+	using owner = std::unique_ptr<T, void(*)(T*)>;
+
+	// Objects erased from a handle table might still be in use by a function
+	// running on another calc thread. They are deleted when calculation ends,
+	// when the add-in is closed, and at the latest when it is unloaded.
+	class retired {
+		using deleters = std::vector<std::function<void()>>;
+		struct list_t : deleters {
+			~list_t()
+			{
+				for (auto& f : *this) {
+					f();
+				}
+			}
+		};
+		inline static std::mutex m;
+		inline static list_t list;
+	public:
 		template<class T>
-		bool operator()(const std::unique_ptr<T>& a, const std::unique_ptr<T>& b) const
+		static void retire(owner<T> p) noexcept
+		{
+			try {
+				std::lock_guard lock(m);
+				list.emplace_back([q = p.get(), del = p.get_deleter()]() { del(q); });
+			}
+			catch (...) {
+				// out of memory, leak it since another thread might be using it
+			}
+			p.release();
+		}
+		// Delete retired objects. No function using handles may be running.
+		static size_t reclaim()
+		{
+			deleters l;
+			{
+				std::lock_guard lock(m);
+				l.swap(list);
+			}
+			for (auto& f : l) {
+				f();
+			}
+
+			return l.size();
+		}
+		static size_t size()
+		{
+			std::lock_guard lock(m);
+
+			return list.size();
+		}
+	};
+
+	// Live handles of type T sharded by pointer so threads looking up
+	// different handles do not contend. Lookups take a shared lock on one shard.
+	// The handle is the pointer bits.
+	template<class T>
+	class handle_table {
+		struct entry {
+			owner<T> p;
+			OPER caller; // cell that created the handle, ErrNA if temporary
+		};
+		struct alignas(64) shard {
+			mutable std::shared_mutex m;
+			std::unordered_map<const T*, entry> map;
+		};
+		static constexpr size_t count = 64;
+		shard shards[count];
+
+		shard& at(const T* p)
+		{
+			auto u = reinterpret_cast<uintptr_t>(p) >> 4; // heap blocks are 16 byte aligned
+			u ^= u >> 17;
+
+			return shards[u % count];
+		}
+		const shard& at(const T* p) const
+		{
+			return const_cast<handle_table*>(this)->at(p);
+		}
+	public:
+		// Take ownership of p and return its handle.
+		HANDLEX insert(owner<T> p, OPER caller)
+		{
+			const T* q = p.get();
+			shard& s = at(q);
+			std::unique_lock lock(s.m);
+			s.map.insert_or_assign(q, entry{ std::move(p), std::move(caller) });
+
+			return to_handle(q);
+		}
+		// Pointer encoded by h without checking it is live.
+		T* decode(HANDLEX h) const
+		{
+			return to_pointer<T>(h);
+		}
+		// Retire the object of h and return its pointer if it was in the table.
+		T* erase(HANDLEX h)
+		{
+			const T* p = decode(h);
+			shard& s = at(p);
+			owner<T> q(nullptr, nullptr);
+			{
+				std::unique_lock lock(s.m);
+				auto i = s.map.find(p);
+				if (i == s.map.end()) {
+					return nullptr;
+				}
+				q = std::move(i->second.p);
+				s.map.erase(i);
+			}
+			T* r = q.get();
+			retired::retire(std::move(q));
+
+			return r;
+		}
+		bool contains(HANDLEX h) const
+		{
+			const T* p = decode(h);
+			const shard& s = at(p);
+			std::shared_lock lock(s.m);
+
+			return s.map.contains(p);
+		}
+		// Caller of h is c.
+		bool caller_is(HANDLEX h, const XLOPER12& c) const
+		{
+			const T* p = decode(h);
+			const shard& s = at(p);
+			std::shared_lock lock(s.m);
+			const auto i = s.map.find(p);
+
+			return i != s.map.end() && i->second.caller == c;
+		}
+		// Set the caller of h to c if it exists.
+		void set_caller(HANDLEX h, const XLOPER12& c)
 		{
-			return a.get() < b.get();
+			const T* p = decode(h);
+			shard& s = at(p);
+			std::unique_lock lock(s.m);
+			const auto i = s.map.find(p);
+			if (i != s.map.end()) {
+				i->second.caller = c;
+			}
+		}
+		size_t size() const
+		{
+			size_t n = 0;
+			for (const auto& s : shards) {
+				std::shared_lock lock(s.m);
+				n += s.map.size();
+			}
+
+			return n;
+		}
+		// Handles and the cells that created them.
+		std::vector<std::pair<HANDLEX, OPER>> callers() const
+		{
+			std::vector<std::pair<HANDLEX, OPER>> cs;
+			for (const auto& s : shards) {
+				std::shared_lock lock(s.m);
+				for (const auto& [p, e] : s.map) {
+					cs.emplace_back(to_handle(p), e.caller);
+				}
+			}
+
+			return cs;
+		}
+		// Call f(h, p) for every live handle.
+		template<class F>
+		void for_each(F&& f) const
+		{
+			for (const auto& s : shards) {
+				std::shared_lock lock(s.m);
+				for (const auto& [p, e] : s.map) {
+					f(to_handle(p), e.p.get());
+				}
+			}
+		}
+	};
+
+	// Number of handle_slots types used.
+	inline std::atomic<uint64_t> slot_tags = 0;
+
+	// Live handles of type T in a dense array of slots.
+	// The handle is the slot index plus one in the low 26 bits, a 16 bit
+	// generation above that, and an 11 bit tag for T in the top bits, so
+	// it is an integer below 2^53. Lookup is an index, generation, and tag
+	// compare, stale handles to reused slots and handles of other types
+	// are detected, and iteration is over contiguous memory. A slot is
+	// retired when its generation would wrap so stale handles never match.
+	// Use handle<T, handle_slots<T>> or slot_handle<T>.
+	template<class T>
+	class handle_slots {
+		struct slot {
+			uint16_t gen = 0; // odd if live
+			owner<T> p{ nullptr, nullptr };
+			OPER caller;
+		};
+		mutable std::shared_mutex m;
+		std::vector<slot> slots;
+		std::vector<uint32_t> free; // unused slot indices
+		size_t live = 0;
+
+		static constexpr int index_bits = 26;
+		static constexpr int gen_bits = 16;
+		static constexpr uint64_t max_slots = (uint64_t(1) << index_bits) - 1;
+
+		// Distinct for each T, nonzero, and wraps after 2047 types.
+		static uint64_t tag()
+		{
+			static const uint64_t t = slot_tags.fetch_add(1, std::memory_order_relaxed) % 2047 + 1;
+
+			return t;
+		}
+		static HANDLEX encode(uint32_t i, uint16_t gen)
+		{
+			return static_cast<HANDLEX>((tag() << (index_bits + gen_bits)) | (uint64_t(gen) << index_bits) | (uint64_t(i) + 1));
+		}
+		// Live slot of h or nullptr.
+		const slot* at(HANDLEX h) const
+		{
+			if (!(h > 0 && h < 0x1p53)) { // also NaN
+				return nullptr;
+			}
+			const auto u = static_cast<uint64_t>(h);
+			if ((u >> (index_bits + gen_bits)) != tag()) {
+				return nullptr;
+			}
+			const auto i = static_cast<uint32_t>(u & max_slots) - 1;
+			if (i >= slots.size() || slots[i].gen != static_cast<uint16_t>(u >> index_bits) || !(slots[i].gen & 1)) {
+				return nullptr;
+			}
+
+			return &slots[i];
+		}
+		slot* at(HANDLEX h)
+		{
+			return const_cast<slot*>(std::as_const(*this).at(h));
+		}
+	public:
+		HANDLEX insert(owner<T> p, OPER caller)
+		{
+			std::unique_lock lock(m);
+			uint32_t i;
+			if (!free.empty()) {
+				i = free.back();
+				free.pop_back();
+			}
+			else if (slots.size() == max_slots) {
+				lock.unlock();
+				retired::retire(std::move(p));
+
+				return INVALID_HANDLEX;
+			}
+			else {
+				i = static_cast<uint32_t>(slots.size());
+				slots.emplace_back();
+			}
+			slot& s = slots[i];
+			++s.gen;
+			s.p = std::move(p);
+			s.caller = std::move(caller);
+			++live;
+
+			return encode(i, s.gen);
+		}
+		// Pointer in the slot of h if it is live.
+		T* decode(HANDLEX h) const
+		{
+			std::shared_lock lock(m);
+			const slot* s = at(h);
+
+			return s ? s->p.get() : nullptr;
+		}
+		T* erase(HANDLEX h)
+		{
+			owner<T> q(nullptr, nullptr);
+			{
+				std::unique_lock lock(m);
+				slot* s = at(h);
+				if (!s) {
+					return nullptr;
+				}
+				++s->gen; // even, stale handles no longer match
+				q = std::move(s->p);
+				s->caller = OPER{};
+				if (s->gen != 0) {
+					free.push_back(static_cast<uint32_t>(s - slots.data()));
+				}
+				// else the generation is exhausted and the slot is never reused
+				--live;
+			}
+			T* r = q.get();
+			retired::retire(std::move(q));
+
+			return r;
+		}
+		bool contains(HANDLEX h) const
+		{
+			std::shared_lock lock(m);
+
+			return at(h) != nullptr;
+		}
+		bool caller_is(HANDLEX h, const XLOPER12& c) const
+		{
+			std::shared_lock lock(m);
+			const slot* s = at(h);
+
+			return s && s->caller == c;
+		}
+		void set_caller(HANDLEX h, const XLOPER12& c)
+		{
+			std::unique_lock lock(m);
+			if (slot* s = at(h)) {
+				s->caller = c;
+			}
+		}
+		size_t size() const
+		{
+			std::shared_lock lock(m);
+
+			return live;
+		}
+		std::vector<std::pair<HANDLEX, OPER>> callers() const
+		{
+			std::vector<std::pair<HANDLEX, OPER>> cs;
+			std::shared_lock lock(m);
+			for (uint32_t i = 0; i < slots.size(); ++i) {
+				if (slots[i].gen & 1) {
+					cs.emplace_back(encode(i, slots[i].gen), slots[i].caller);
+				}
+			}
+
+			return cs;
+		}
+		template<class F>
+		void for_each(F&& f) const
+		{
+			std::shared_lock lock(m);
+			for (uint32_t i = 0; i < slots.size(); ++i) {
+				if (slots[i].gen & 1) {
+					f(encode(i, slots[i].gen), slots[i].p.get());
+				}
+			}
+		}
+	};
+
+	// Objects are only deleted when the cell that created them is recalculated.
+	// Deleting the cell, closing its workbook, or overwriting it leaves them
+	// in their table. handle_gc::sweep() erases handles of every type that are
+	// no longer in the cell that created them or anywhere else on its sheet,
+	// as a number or encoded in a string. Call it from a macro such as
+	// XLL.HANDLE.SWEEP, e.g., OnRecalc xlor("", "XLL.HANDLE.SWEEP");
+	class handle_gc {
+	public:
+		struct stats {
+			size_t handles = 0; // live before the sweep
+			size_t swept = 0;
+			size_t bytes = 0; // sizeof static type of swept objects
+
+			stats& operator+=(const stats& s)
+			{
+				handles += s.handles;
+				swept += s.swept;
+				bytes += s.bytes;
+
+				return *this;
+			}
+		};
+	private:
+		inline static std::mutex m;
+		inline static std::vector<stats(*)()> sweeps;
+
+		static stats& total_()
+		{
+			static stats s;
+
+			return s;
+		}
+	public:
+		// Called once for each handle type.
+		static void add(stats(*sweep)())
+		{
+			std::lock_guard lock(m);
+			sweeps.push_back(sweep);
+		}
+
+		// Value x is handle h or a string encoding it.
+		using holds_t = bool(*)(const XLOPER12& x, HANDLEX h);
+
+		// Values in the used range of the sheets of creating cells, read once per sweep.
+		class sheets {
+			struct values {
+				std::unordered_set<double> nums;
+				std::vector<OPER> strs;
+			};
+			std::unordered_map<IDSHEET, values> map; // SRefs are on sheet 0
+
+			static values read(const OPER& cell)
+			{
+				values v;
+				const OPER name = Excel(xlSheetNm, cell);
+				int b[4]; // first and last used row and column, 1-based
+				for (int i = 0; i < 4; ++i) {
+					b[i] = static_cast<int>(asNum(Excel(xlfGetDocument, 9 + i, name)));
+				}
+				if (b[0] == 0) {
+					return v; // empty sheet
+				}
+				const REF r(b[0] - 1, b[2] - 1, b[1] - b[0] + 1, b[3] - b[2] + 1);
+				OPER used(r);
+				if (isRef(cell)) {
+					XLMREF12 m{ .count = 1, .reftbl = { r } };
+					XLOPER12 x{};
+					x.xltype = xltypeRef;
+					x.val.mref.lpmref = &m;
+					x.val.mref.idSheet = cell.val.mref.idSheet;
+					used = x;
+				}
+				const xlfree o = Excel<xlfree>(xlCoerce, used);
+				const bool multi = type(o) == xltypeMulti;
+				const XLOPER12* a = multi ? o.val.array.lparray : &o;
+				for (int i = 0; i < (multi ? size(o) : 1); ++i) {
+					if (type(a[i]) == xltypeNum) {
+						v.nums.insert(a[i].val.num);
+					}
+					else if (type(a[i]) == xltypeStr) {
+						v.strs.emplace_back(a[i]);
+					}
+				}
+
+				return v;
+			}
+		public:
+			// Some cell on the sheet of cell holds h.
+			bool contains(const OPER& cell, HANDLEX h, holds_t holds)
+			{
+				const IDSHEET id = isRef(cell) ? cell.val.mref.idSheet : 0;
+				auto i = map.find(id);
+				if (i == map.end()) {
+					i = map.emplace(id, read(cell)).first;
+				}
+				if (i->second.nums.contains(h)) {
+					return true;
+				}
+
+				return std::ranges::any_of(i->second.strs, [h, holds](const OPER& s) { return holds(s, h); });
+			}
+		};
+
+		// The cell that created h still holds it. Inserting or deleting rows
+		// or columns, cut and paste, and sorting move cells without recalculating
+		// them, so h is also reachable from any cell on the same sheet.
+		static bool reachable(HANDLEX h, const OPER& caller, holds_t holds, sheets& cells)
+		{
+			if (caller == ErrNA) {
+				return false; // temporary never erased
+			}
+			if (!isRef(caller) && !isSRef(caller)) {
+				return true; // not created by a cell
+			}
+			try {
+				const xlfree o = Excel<xlfree>(xlCoerce, caller);
+				const bool multi = type(o) == xltypeMulti;
+				const XLOPER12* a = multi ? o.val.array.lparray : &o;
+				for (int i = 0; i < (multi ? size(o) : 1); ++i) {
+					if (holds(a[i], h)) {
+						return true;
+					}
+				}
+
+				return cells.contains(caller, h, holds);
+			}
+			catch (const std::exception&) {
+				// sheet no longer exists
+			}
+
+			return false;
+		}
+
+		// Erase unreachable handles of every type. No function may be running.
+		static stats sweep()
+		{
+			std::lock_guard lock(m);
+			stats s;
+			for (auto f : sweeps) {
+				s += f();
+			}
+			total_() += s;
+
+			return s;
+		}
+		// Totals of all sweeps.
+		static stats total()
+		{
+			std::lock_guard lock(m);
+
+			return total_();
+		}
+	};
+
+	// Population and usage of each handle type for HANDLE.STATS.
+	// Creation and erasure are counted exactly. One in sample lookups on
+	// each thread is timed and counted as sample lookups so the hot path
+	// does not touch shared counters.
+	class handle_stats {
+	public:
+		using clock = std::chrono::steady_clock;
+		static constexpr unsigned sample = 64;
+		static constexpr size_t buckets = 32; // latency in [2^(i-1), 2^i) ns
+
+		struct counters {
+			std::atomic<uint64_t> created = 0;
+			std::atomic<uint64_t> erased = 0;
+			std::atomic<uint64_t> lookups = 0;
+			std::atomic<uint64_t> misses = 0; // unknown handles
+			std::array<std::atomic<uint64_t>, buckets> latency = {};
+		};
+		struct type {
+			const char* name; // typeid(T).name()
+			size_t size; // sizeof(T)
+			size_t(*live)();
+			const counters* count;
+		};
+
+		// Time a sampled lookup. Each type keeps its own thread_local tick
+		// so interleaved lookups of several types are all sampled.
+		class timer {
+			counters& c;
+			clock::time_point start;
+		public:
+			timer(counters& c, unsigned& tick) noexcept
+				: c(c)
+			{
+				if (++tick == sample) {
+					tick = 0;
+					start = clock::now();
+				}
+			}
+			timer(const timer&) = delete;
+			timer& operator=(const timer&) = delete;
+			~timer()
+			{
+				if (start != clock::time_point{}) {
+					const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count();
+					const size_t i = (std::min)(static_cast<size_t>(std::bit_width(static_cast<uint64_t>(ns))), buckets - 1);
+					c.latency[i].fetch_add(1, std::memory_order_relaxed);
+					c.lookups.fetch_add(sample, std::memory_order_relaxed);
+				}
+			}
+		};
+	private:
+		inline static std::mutex m;
+		inline static std::vector<type> types_;
+		inline static const clock::time_point start = clock::now();
+	public:
+		// Called once for each handle type.
+		static void add(const type& t)
+		{
+			std::lock_guard lock(m);
+			types_.push_back(t);
+		}
+		static std::vector<type> types()
+		{
+			std::lock_guard lock(m);
+
+			return types_;
+		}
+		// Seconds since the add-in was loaded.
+		static double seconds()
+		{
+			return std::chrono::duration<double>(clock::now() - start).count();
+		}
+		// Upper bound in ns of the q-th quantile of sampled lookup latency.
+		static double quantile(const counters& c, double q)
+		{
+			uint64_t n = 0;
+			for (const auto& b : c.latency) {
+				n += b;
+			}
+			if (n == 0) {
+				return 0;
+			}
+			uint64_t k = 0;
+			for (size_t i = 0; i < buckets; ++i) {
+				k += c.latency[i];
+				if (k >= q * n) {
+					return std::ldexp(1., static_cast<int>(i));
+				}
+			}
+
+			return std::ldexp(1., buckets);
+		}
+
+		// One row per handle type below a header.
+		static OPER table()
+		{
+			const auto ts = types();
+			const double t = seconds();
+			OPER o(1 + static_cast<int>(ts.size()), 12);
+			int j = 0;
+			for (const char* h : { "Type", "Live", "Bytes", "Created", "Erased", "Lookups", "Misses",
+				"Created/s", "Erased/s", "Lookups/s", "p50 ns", "p99 ns" }) {
+				o(0, j++) = OPER(h);
+			}
+			for (int i = 0; i < static_cast<int>(ts.size()); ++i) {
+				const auto& [name, size, live, c] = ts[i];
+				const size_t n = live();
+				const double values[] = {
+					double(n), double(n * size),
+					double(c->created), double(c->erased), double(c->lookups), double(c->misses),
+					c->created / t, c->erased / t, c->lookups / t,
+					quantile(*c, 0.5), quantile(*c, 0.99),
+				};
+				o(i + 1, 0) = OPER(name);
+				for (j = 0; j < 11; ++j) {
+					o(i + 1, j + 1) = OPER(values[j]);
+				}
+			}
+
+			return o;
 		}
 	};
 
@@ -111,117 +934,204 @@ namespace xll {
 	/// 
 	/// Use <c>handle<T> h(new T(...))</c> to create a handle
 	/// and <c>get()</c> to return a <c>HANDLEX</c> to Excel.
+	/// <c>auto h = handle<T>::make(...)</c> recycles storage from a pool.
 	/// Functions that create handles must be uncalced.
 	/// 
 	/// Use <c>handle<T> h_(h)</c> to lookup <c>h</c> returned by <c>get()</c>.
-	/// Functions that use handles do not need to be uncalced.
+	/// Functions that use handles do not need to be uncalced and can be thread-safe.
+	/// A <c>caller_scope</c> avoids calling xlfCaller for every handle.
 	/// Unknown handles return null pointers.
 	/// This can be circumvented by using <c>handle<T> h_(h, false)</c>
 	/// to prevent the lookup.
+	/// 
+	/// The default table encodes the pointer bits in the handle.
+	/// Use <c>handle<T, handle_slots<T>></c> for slot and generation handles.
 	/// </summary>
-	template<class T>
+	template<class T, class Table = handle_table<T>>
 	class handle {
-		// all active pointers of type T*
-		inline static std::set<std::unique_ptr<T>, unique_ptrcmp<T>> ps;
-		// caller of handle
-		inline static std::map<T*, OPER> caller;
+		// all active pointers of type T* and the cell they were created in
+		inline static Table ps;
+		inline static handle_stats::counters count;
 
-		static void erase(T* p) noexcept
+		static void erase(HANDLEX h) noexcept
 		{
-			if (p != nullptr) {
-				auto p_ = ps.find(p);
-				if (p_ != ps.end()) {
-					ps.erase(p_);
-				}
-				auto ph = handle_typename.find(p);
-				if (ph != handle_typename.end()) {
-					handle_typename.erase(ph);
-				}
+			if (T* p = ps.erase(h)) {
+				handle_typename.erase(p);
+				count.erased.fetch_add(1, std::memory_order_relaxed);
 			}
 		}
 
-		// Convert handle in caller to pointer.
-		static T* coerce(const OPER& cell)
+		// Handle in caller.
+		static HANDLEX coerce(const OPER& cell)
 		{
-			const OPER o = Excel(xlCoerce, cell);
+			const xlfree o = Excel<xlfree>(xlCoerce, cell);
 
-			return o.xltype == xltypeNum ? to_pointer<T>(o.val.num) : nullptr;
+			return type(o) == xltypeNum ? o.val.num : INVALID_HANDLEX;
 		}
 
-		// underlying pointer
-		T* p;
+		HANDLEX h; // returned to Excel
+		T* p; // underlying pointer
+		bool temporary = false; // erase on destruction
+
+		// Calling Excel or allocating can throw. Then the object is
+		// deleted and the handle is invalid.
+		handle(owner<T> o) noexcept
+			: h{ INVALID_HANDLEX }, p{ nullptr }
+		{
+			T* const p_ = o.get();
+			try {
+				[[maybe_unused]] static const bool registered = (
+					handle_gc::add(sweep),
+					handle_typename.add([](HANDLEX h) -> const void* { return ps.contains(h) ? ps.decode(h) : nullptr; }),
+					handle_stats::add({ typeid(T).name(), sizeof(T), size, &count }),
+					true);
+				count.created.fetch_add(1, std::memory_order_relaxed);
+				OPER caller = caller_scope::caller();
+				// delete and erase if calling cell has a valid handle to T
+				const HANDLEX q = coerce(caller);
+				// returned by HANDLE.TYPENAME(handle)
+				handle_typename.insert(p_, typeid(*p_).name());
+				h = ps.insert(std::move(o), std::move(caller));
+				if (std::isnan(h)) { // table full
+					handle_typename.erase(p_);
+				}
+				else {
+					p = p_;
+				}
+				if (!std::isnan(q) && q != h) {
+					erase(q);
+				}
+			}
+			catch (...) {
+				handle_typename.erase(p_);
+				h = INVALID_HANDLEX;
+			}
+		}
 	public:
 		/// <summary>
 		/// Add a handle to the collection.
 		/// </summary>
 		explicit handle(T* p) noexcept
-			: p{ p }
+			: handle(owner<T>(p, [](T* p_) { delete p_; }))
+		{ }
+		/// <summary>
+		/// Construct a U in the pool of U objects and add a handle to it.
+		/// </summary>
+		template<class U = T, class... Args>
+			requires std::is_base_of_v<T, U>
+		static handle make(Args&&... args)
 		{
-			// store unique_ptr
-			ps.emplace(std::unique_ptr<T>(p));
+			U* u = object_pool<U>::instance().construct(std::forward<Args>(args)...);
 
-			// delete and erase if calling cell has a valid pointer to T
-			erase(coerce(caller[p] = Excel(xlfCaller)));
-
-			// returned by HANDLE.TYPENAME(handle)
-			handle_typename[p] = typeid(*p).name();
+			return handle(owner<T>(u, [](T* p_) { object_pool<U>::instance().destroy(static_cast<U*>(p_)); }));
 		}
 		/// <summary>
 		/// Lookup an existing handle.
 		/// </summary>
 		handle(HANDLEX h, bool check = true) noexcept
-			: p(to_pointer<T>(h))
+			: h(h), p(nullptr)
 		{
-			if (check && p) {
-				if (!ps.contains(p) && !safe_pointers.contains(p)) {
-					// unknown handle
-					p = nullptr;
+			thread_local unsigned tick = 0;
+			handle_stats::timer timer(count, tick);
+			p = ps.decode(h);
+			if (!p) {
+				count.misses.fetch_add(1, std::memory_order_relaxed);
+
+				return;
+			}
+			if (ps.contains(h)) {
+				// handle was created by a function argument
+				if (caller_scope::check_temporaries() && ps.caller_is(h, caller_scope::caller())) {
+					ps.set_caller(h, ErrNA);
+					temporary = true;
 				}
 			}
-			// handle was created by a function argument
-			if (p && !safe_pointers.contains(p) && caller[p] == Excel(xlfCaller)) {
-				is_temporary(p);
+			else if (check && !safe_pointers.contains(p)) {
+				// unknown handle
+				p = nullptr;
+				count.misses.fetch_add(1, std::memory_order_relaxed);
 			}
 		}
 		handle(const handle&) = delete;
 		handle& operator=(const handle&) = delete;
-		handle(handle&& h) noexcept
-			: p(h.p)
+		handle(handle&& h_) noexcept
+			: h(h_.h), p(h_.p), temporary(std::exchange(h_.temporary, false))
 		{ }
-		handle& operator=(handle&& h) noexcept
+		handle& operator=(handle&& h_) noexcept
 		{
-			if (p != h.p) {
-				swap(h);
+			if (p != h_.p) {
+				swap(h_);
 			}
 
 			return *this;
 		}
 		~handle()
 		{
-			if (is_temporary()) {
-				erase(p);
+			if (temporary) {
+				erase(h);
+			}
+		}
+
+		// Number of live handles of type T.
+		static size_t size()
+		{
+			return ps.size();
+		}
+		// Usage of handles of type T.
+		static const handle_stats::counters& stats()
+		{
+			return count;
+		}
+		// x is h or a string encoding h.
+		static bool holds(const XLOPER12& x, HANDLEX h)
+		{
+			return (type(x) == xltypeNum && x.val.num == h) || codec::contains(x, h);
+		}
+		// Erase handles of type T no longer on the sheet of the cell that created them.
+		static handle_gc::stats sweep()
+		{
+			handle_gc::stats s;
+			handle_gc::sheets cells;
+			for (const auto& [h, caller] : ps.callers()) {
+				++s.handles;
+				if (!handle_gc::reachable(h, caller, holds, cells)) {
+					erase(h);
+					++s.swept;
+					s.bytes += sizeof(T);
+				}
 			}
+
+			return s;
+		}
+		// Call f(h, p) for every live handle of type T.
+		template<class F>
+		static void for_each(F&& f)
+		{
+			ps.for_each(std::forward<F>(f));
 		}
 
 		// mark p_ as temporary
 		void is_temporary(T* p_)
 		{
-			if (!safe_pointers.contains((void*)p_)) {
-				caller[p_] = ErrNA;
+			if (p_ == p && !safe_pointers.contains((void*)p_)) {
+				ps.set_caller(h, ErrNA);
+				temporary = true;
 			}
 		}
 
 		[[nodiscard]] bool is_temporary() const
 		{
-			return (!safe_pointers.contains((void*)p)) && caller[p] == ErrNA;
+			return p && !safe_pointers.contains((void*)p) && ps.caller_is(h, ErrNA);
 		}
 
-		void swap(handle& h) noexcept
+		void swap(handle& h_) noexcept
 		{
 			using std::swap;
 
 			// ps unchanged
-			swap(p, h.p);
+			swap(h, h_.h);
+			swap(p, h_.p);
+			swap(temporary, h_.temporary);
 		}
 
 		explicit operator bool() const
@@ -232,7 +1142,7 @@ namespace xll {
 		// return value for Excel
 		[[nodiscard]] HANDLEX get() const
 		{
-			return to_handle(p);
+			return p ? h : to_handle(p);
 		}
 		// underlying pointer
 		[[nodiscard]] T* ptr() const
@@ -272,32 +1182,25 @@ namespace xll {
 			{
 				return static_cast<XCHAR>(h <= 9 ? '0' + h : 'A' + h - 10);
 			}
+			// hex digits of all 64 bits, slot handles use more than 48
+			static constexpr unsigned digits = 2 * sizeof(uint64_t);
 			// "01..F" -> h
-			static HANDLEX decode_(LPWSTR pc)
+			static HANDLEX decode_(const XCHAR* pc)
 			{
-				union {
-					T* h;
-					uint8_t c[8];
-				} hc = { 0 };
-
-				for (unsigned i = 0; i < 6; ++i) {
-					hc.c[5 - i] = (c2h(pc[2 * i]) << 4) + c2h(pc[2 * i + 1]);
+				uint64_t u = 0;
+				for (unsigned i = 0; i < digits; ++i) {
+					u = (u << 4) + c2h(pc[i]);
 				}
 
-				return to_handle<T>(hc.h);
+				return static_cast<HANDLEX>(u);
 			}
 			// h -> "01..F"
 			static void encode_(HANDLEX h, XCHAR* pc)
 			{
-				union {
-					T* h;
-					uint8_t c[8];
-				} hc;
-				hc.h = to_pointer<T>(h);
-
-				for (unsigned i = 0; i < 6; ++i) {
-					pc[2 * i] = h2c(hc.c[5 - i] >> 4);
-					pc[2 * i + 1] = h2c(hc.c[5 - i] & 0x0F);
+				// 0 for NaN and infinities
+				const uint64_t u = h >= 0 && h < 0x1p53 ? static_cast<uint64_t>(h) : 0;
+				for (unsigned i = 0; i < digits; ++i) {
+					pc[i] = h2c((u >> (4 * (digits - 1 - i))) & 0x0F);
 				}
 			}
 
@@ -308,7 +1211,7 @@ namespace xll {
 			codec(const char* prefix, const char* suffix)
 				: H(prefix), off(H.val.str[0])
 			{
-				H &= OPER("456789ABCDEF");
+				H &= OPER("0123456789ABCDEF");
 				H &= OPER(suffix);
 			}
 			// use 
@@ -324,6 +1227,18 @@ namespace xll {
 				return H;
 			}
 
+			// String x has the digits of h after any prefix.
+			static bool contains(const XLOPER12& x, HANDLEX h)
+			{
+				if (type(x) != xltypeStr) {
+					return false;
+				}
+				XCHAR d[digits];
+				encode_(h, d);
+
+				return view(x).find(std::wstring_view(d, digits)) != std::wstring_view::npos;
+			}
+
 			// does not allocate memory
 			HANDLEX decode(const OPER& H_)
 			{
@@ -339,5 +1254,9 @@ namespace xll {
 		};
 		
 	};
+
+	// Handles of slot index and generation.
+	template<class T>
+	using slot_handle = handle<T, handle_slots<T>>;
 	
 }
\ No newline at end of file
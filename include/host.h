@@ -0,0 +1,43 @@
+// host.h - In-process stand-in for Excel to run the library without Excel.
+// Copyright (c) KALX, LLC. All rights reserved. No warranty made.
+// Call xll::host::install() before the first Excel call. It hands
+// xll::host::callback to SetExcel12EntryPt and every Excel12v call
+// is dispatched to the handler registered for the function number.
+// Default handlers cover what the library itself calls: xlFree, xlCoerce,
+// xlSheetNm, xlGetName, xlfCaller, xlfEvaluate, xlfRegister, xlfUnregister,
+// xlfSetName, xlcDefineName, xlSet, xlcSelect, xlcEcho, xlcOptionsCalculation,
+// GET.WORKSPACE(40), and GET.DOCUMENT(9-12, 14). The workbook has one sheet.
+// Use host::on to add or replace handlers.
+// Excel may be called from any thread, handlers run concurrently.
+#pragma once
+#include <functional>
+#include "oper.h"
+
+namespace xll::host {
+
+	// Compute the result of an Excel function. Return an xlret code.
+	using handler = std::function<int(int count, LPXLOPER12* opers, LPXLOPER12 res)>;
+
+	// Set the handler for xlfn and return the previous one.
+	handler on(int xlfn, handler f);
+
+	// Same signature as MdCallBack12 in Excel. The xlIntl and xlPrompt bits are ignored.
+	int PASCAL callback(int xlfn, int count, LPXLOPER12* opers, LPXLOPER12 res);
+
+	// Install callback as the Excel12v entry point.
+	void install();
+
+	// Value of xlfCaller on the calling thread. Defaults to R1C1.
+	OPER& caller();
+
+	// Cell values returned by xlCoerce of a reference.
+	// Do not assign while other threads call Excel.
+	OPER& cell(RW row, COL column);
+
+	// Copy x to res so the caller owns it until calling xlFree.
+	void result(LPXLOPER12 res, const XLOPER12& x);
+
+	// Number of Excel12v calls made so far.
+	size_t calls();
+
+} // namespace xll::host
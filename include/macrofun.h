@@ -2,6 +2,9 @@
 // This header makes it convenient to call macro functions 
 // documented in https://xlladdins.github.io/Excel4Macros/
 #pragma once
+#include <algorithm>
+#include <utility>
+#include <vector>
 #include "excel.h"
 
 #pragma region RGB_COLOR
@@ -166,6 +169,297 @@ XLL_RGB_COLOR(XLL_RGB_COLOR_ENUM)
 
 namespace xll {
 
+	// Queue commands called with command() while alive and issue them on flush.
+	// Consecutive xlcSelect calls collapse to the last one and xlSet calls
+	// that tile a rectangle of one sheet are written as a single range.
+	// xlSet and xlcSelect commute so writes are held until another command.
+	// Only queue commands whose result is not used and call sync() before
+	// calling functions that read what the batch writes.
+	class command_batch {
+		struct call {
+			int fn;
+			std::vector<OPER> args;
+		};
+		struct write {
+			IDSHEET sheet;
+			bool sref; // xltypeSRef on the active sheet
+			REF ref;
+			OPER value; // scalar or array the size of ref
+		};
+		std::vector<call> calls;
+		std::vector<write> writes;
+		OPER selection; // Nil if unknown
+		size_t recorded_ = 0;
+		size_t issued_ = 0;
+		command_batch* prev;
+
+		static command_batch*& current_() noexcept
+		{
+			thread_local command_batch* p = nullptr;
+
+			return p;
+		}
+
+		// Commands that do not change the selection.
+		static bool keeps_selection(int fn)
+		{
+			switch (fn) {
+			case xlcAlignment:
+			case xlcApplyStyle:
+			case xlcBorder:
+			case xlcDefineName:
+			case xlcDefineStyle:
+			case xlcFormatFont:
+			case xlcFormatNumber:
+			case xlcFormula:
+				return true;
+			}
+
+			return false;
+		}
+
+		// Queue xlSet as a write if it can be merged.
+		bool queue_write(const OPER& ref, const OPER& value)
+		{
+			write w;
+			if (isSRef(ref)) {
+				w = write{ 0, true, ref.val.sref.ref, value };
+			}
+			else if (type(ref) == xltypeRef && ref.val.mref.lpmref->count == 1) {
+				w = write{ ref.val.mref.idSheet, false, ref.val.mref.lpmref->reftbl[0], value };
+			}
+			else {
+				return false;
+			}
+			if (isMulti(value) && (rows(value) != rows(w.ref) || columns(value) != columns(w.ref))) {
+				return false;
+			}
+			writes.push_back(std::move(w));
+
+			return true;
+		}
+
+		static OPER reference(const write& w, const REF& r)
+		{
+			if (w.sref) {
+				return OPER(r);
+			}
+			XLMREF12 m{ .count = 1, .reftbl = { r } };
+			XLOPER12 x{};
+			x.xltype = xltypeRef;
+			x.val.mref.lpmref = &m;
+			x.val.mref.idSheet = w.sheet;
+
+			return OPER(x);
+		}
+
+		// Move queued writes to calls, one xlSet per sheet if they tile a rectangle.
+		void merge()
+		{
+			while (!writes.empty()) {
+				const write& w0 = writes.front();
+				std::vector<write> ws, rest;
+				for (auto& w : writes) {
+					(w.sheet == w0.sheet && w.sref == w0.sref ? ws : rest).push_back(std::move(w));
+				}
+				writes.swap(rest);
+
+				REF box = ws[0].ref;
+				size_t area = 0;
+				for (const auto& w : ws) {
+					box.rwFirst = (std::min)(box.rwFirst, w.ref.rwFirst);
+					box.rwLast = (std::max)(box.rwLast, w.ref.rwLast);
+					box.colFirst = (std::min)(box.colFirst, w.ref.colFirst);
+					box.colLast = (std::max)(box.colLast, w.ref.colLast);
+					area += size(w.ref);
+				}
+				const auto r = rows(box), c = columns(box);
+				bool tiled = ws.size() > 1 && area == size_t(r) * c && area <= (1 << 20);
+				OPER value(tiled ? r : 0, tiled ? c : 0);
+				std::vector<bool> seen(tiled ? area : 0);
+				for (size_t k = 0; tiled && k < ws.size(); ++k) {
+					const auto& w = ws[k];
+					for (int i = 0; tiled && i < rows(w.ref); ++i) {
+						for (int j = 0; j < columns(w.ref); ++j) {
+							const int bi = w.ref.rwFirst - box.rwFirst + i;
+							const int bj = w.ref.colFirst - box.colFirst + j;
+							if (seen[size_t(bi) * c + bj]) {
+								tiled = false; // overlap
+
+								break;
+							}
+							seen[size_t(bi) * c + bj] = true;
+							value(bi, bj) = isMulti(w.value) ? w.value(i, j) : w.value;
+						}
+					}
+				}
+				if (tiled) {
+					calls.push_back(call{ xlSet, { reference(ws[0], box), std::move(value) } });
+				}
+				else {
+					for (auto& w : ws) {
+						calls.push_back(call{ xlSet, { reference(w, w.ref), std::move(w.value) } });
+					}
+				}
+			}
+		}
+	public:
+		command_batch() noexcept
+			: prev(std::exchange(current_(), this))
+		{ }
+		command_batch(const command_batch&) = delete;
+		command_batch& operator=(const command_batch&) = delete;
+		// Call flush() to see errors.
+		~command_batch()
+		{
+			try {
+				flush();
+			}
+			catch (...) {
+			}
+			current_() = prev;
+		}
+
+		// Batch of the calling thread or nullptr.
+		static command_batch* current() noexcept
+		{
+			return current_();
+		}
+		// Issue commands queued on this thread.
+		static void sync()
+		{
+			if (command_batch* b = current()) {
+				b->flush();
+			}
+		}
+
+		void add(int fn, std::vector<OPER> args)
+		{
+			++recorded_;
+			if (fn == xlSet && args.size() == 2 && queue_write(args[0], args[1])) {
+				return;
+			}
+			if (fn == xlcSelect && args.size() == 1) {
+				if (args[0] == selection) {
+					return;
+				}
+				selection = args[0];
+				if (!calls.empty() && calls.back().fn == xlcSelect && calls.back().args.size() == 1) {
+					calls.back().args[0] = selection;
+
+					return;
+				}
+			}
+			else {
+				merge();
+				if (!keeps_selection(fn)) {
+					selection = OPER{};
+				}
+			}
+			calls.push_back(call{ fn, std::move(args) });
+		}
+
+		void flush()
+		{
+			merge();
+			auto cs = std::exchange(calls, {});
+			for (auto& c : cs) {
+				std::vector<LPXLOPER12> pos(c.args.size() + 1);
+				for (size_t i = 0; i < c.args.size(); ++i) {
+					pos[i] = &c.args[i];
+				}
+				XLOPER12 res{};
+				res.xltype = xltypeNil;
+				++issued_;
+				ensure_ret(::Excel12v(c.fn, &res, static_cast<int>(c.args.size()), pos.data()));
+				if (isAlloc(res)) {
+					::Excel12(xlFree, 0, 1, &res);
+				}
+			}
+		}
+
+		// Commands added.
+		size_t recorded() const
+		{
+			return recorded_;
+		}
+		// Excel calls made.
+		size_t issued() const
+		{
+			return issued_;
+		}
+	};
+
+	// Queue the command if a command_batch is alive, otherwise call Excel.
+	template<class... Ts>
+	inline void command(int fn, Ts&&... ts)
+	{
+		if (command_batch* b = command_batch::current()) {
+			std::vector<OPER> args;
+			args.reserve(sizeof...(ts));
+			(args.emplace_back(std::forward<Ts>(ts)), ...);
+			b->add(fn, std::move(args));
+		}
+		else {
+			Excel(fn, std::forward<Ts>(ts)...);
+		}
+	}
+
+	// Turn off screen updating and automatic calculation for the lifetime of the scope.
+	// The destructor restores the previous settings, also when an exception unwinds.
+	// Declare before a command_batch so queued commands are issued while suspended.
+	class Suspend {
+		OPER echo; // screen updating to restore or Nil
+		OPER calculation; // calculation mode to restore or Nil
+
+		void restore() noexcept
+		{
+			try {
+				command_batch::sync();
+			}
+			catch (...) {
+			}
+			if (!isNil(calculation)) {
+				Excel12(xlcOptionsCalculation, 0, 1, &calculation);
+			}
+			if (!isNil(echo)) {
+				Excel12(xlcEcho, 0, 1, &echo);
+			}
+		}
+	public:
+		// GET.DOCUMENT(14) and OPTIONS.CALCULATION type_num
+		enum class Calculation {
+			Automatic = 1,
+			AutomaticExceptTables = 2,
+			Manual = 3,
+		};
+
+		Suspend(bool screen = false, Calculation calc = Calculation::Manual)
+		{
+			try {
+				if (Excel(xlfGetWorkspace, 40) != screen) { // screen updating
+					Excel(xlcEcho, screen);
+					echo = !screen;
+				}
+				OPER mode = Excel(xlfGetDocument, 14); // calculation mode
+				if (mode != static_cast<int>(calc)) {
+					Excel(xlcOptionsCalculation, static_cast<int>(calc));
+					calculation = mode;
+				}
+			}
+			catch (...) {
+				restore();
+				throw;
+			}
+		}
+		Suspend(const Suspend&) = delete;
+		Suspend& operator=(const Suspend&) = delete;
+		~Suspend()
+		{
+			restore();
+		}
+	};
+
 	// https://xlladdins.github.io/Excel4Macros/alignment.html
 	// Alignment().Member(value)... operates on active cell. 
 	// Destructor calls xlcAlignment if set is true.
@@ -210,7 +504,7 @@ namespace xll {
 		~Alignment()
 		{
 			if (set) {
-				Excel(xlcAlignment, horiz_align, wrap, vert_align, orientation, add_indent, shrink_to_fit, merge_cells);
+				command(xlcAlignment, horiz_align, wrap, vert_align, orientation, add_indent, shrink_to_fit, merge_cells);
 			}
 		}
 		Alignment& Horizontal(Alignment::Horizontal horiz)
@@ -313,7 +607,7 @@ namespace xll {
 
 		~Border()
 		{
-			Excel(xlcBorder, outline, left, right, top, bottom, shade, outline_color, left_color, right_color, top_color, bottom_color);
+			command(xlcBorder, outline, left, right, top, bottom, shade, outline_color, left_color, right_color, top_color, bottom_color);
 		}
 		Border& Outline(Line line)
 		{
@@ -431,7 +725,7 @@ namespace xll {
 		~FormatFont()
 		{
 			if (set) {
-				Excel(xlcFormatFont, name_text, size_num,
+				command(xlcFormatFont, name_text, size_num,
 					bold, italic, underline, strike,
 					color, outline, shadow);
 			}
@@ -494,7 +788,7 @@ namespace xll {
 	};
 	
 	// https://xlladdins.github.io/Excel4Macros/define.style.html
-	// Calls xlcDefineStyle immediately.
+	// Calls xlcDefineStyle immediately unless in a command_batch.
 	struct DefineStyle {
 		OPER name;
 
@@ -504,14 +798,14 @@ namespace xll {
 		// Number format, using the arguments from the FORMAT.NUMBER function
 		DefineStyle& Number(const wchar_t* number)
 		{
-			Excel(xlcDefineStyle, name, 2, number);
+			command(xlcDefineStyle, name, 2, number);
 
 			return *this;
 		}
 		// Number format, using the arguments from the FORMAT.NUMBER function
 		DefineStyle& FormatFont(const FormatFont& format)
 		{
-			Excel(xlcDefineStyle, name, 3, 
+			command(xlcDefineStyle, name, 3, 
 				format.name_text, 
 				format.size_num, 
 				format.bold,
@@ -526,7 +820,7 @@ namespace xll {
 		}
 		DefineStyle& Alignment(const Alignment& align)
 		{
-			Excel(xlcDefineStyle, name, 4,
+			command(xlcDefineStyle, name, 4,
 				align.horiz_align,
 				align.wrap,
 				align.vert_align,
@@ -536,7 +830,7 @@ namespace xll {
 		}
 		DefineStyle& Border(const Border& border)
 		{
-			Excel(xlcDefineStyle, name, 5,
+			command(xlcDefineStyle, name, 5,
 				border.outline,
 				border.left,
 				border.right,
@@ -560,27 +854,27 @@ namespace xll {
 		OPER selection;
 
 		Select()
-			: selection(Excel(xlfSelection))
+			: selection((command_batch::sync(), Excel(xlfSelection)))
 		{ }
 
 		// Set active cell of selection.
 		Select& ActiveCell(const OPER& cell)
 		{
-			Excel(xlcSelect, selection, cell);
+			command(xlcSelect, selection, cell);
 			
 			return *this;
 		}
 		Select& Offset(int row, int col)
 		{
 			selection = Excel(xlfOffset, selection, row, col);
-			Excel(xlcSelect, selection);
+			command(xlcSelect, selection);
 
 			return *this;
 		}
 		Select& Offset(int row, int col, int height, int width)
 		{
 			selection = Excel(xlfOffset, selection, row, col, height, width);
-			Excel(xlcSelect, selection);
+			command(xlcSelect, selection);
 
 			return *this;
 		}
@@ -4,8 +4,12 @@
 #ifdef _DEBUG
 #include <cassert>
 #endif // _DEBUG
+#include <algorithm>
+#include <cstring>
 #include <initializer_list>
 #include <map>
+#include <memory>
+#include "arena.h"
 #include "defines.h"
 #include "utf8.h"
 
@@ -27,6 +31,7 @@ namespace xll {
 
 	struct OPER;
 	// Keep track of nested handles.
+	// Multis returned by compress own their nested handles and free them in dealloc.
 	struct handles {
 		static double handle(OPER* po)
 		{
@@ -60,6 +65,20 @@ namespace xll {
 		}
 	};
 
+	// Where the characters of an OPER string live.
+	// Stored in the XCHAR before the count of val.str.
+	enum class str_storage : XCHAR {
+		heap = 0, // allocated by OPER and freed in dealloc
+		pool = 1, // in the pool of the owning multi and freed with it
+		local = 2, // in val following the val.str pointer, no allocation
+		arena = 3, // in the arena of a thread and freed with it
+	};
+	// Only valid for strings allocated by OPER.
+	constexpr str_storage storage(const XLOPER12& x)
+	{
+		return static_cast<str_storage>(x.val.str[-1]);
+	}
+
 	struct OPER : public XLOPER12 {
 		using value_type = OPER;
 		// xltypeNil
@@ -95,17 +114,34 @@ namespace xll {
 			return operator=(static_cast<const XLOPER12&>(o));
 		}
 		
+		// Strings stored in the pool of a multi or in o itself are copied, not stolen.
+		// So is memory moved into or out of an arena.
 		OPER(OPER&& o) noexcept
 			: XLOPER12{ o }
 		{
+			if (isPooled(o) || isLocal(o)) {
+				alloc(Str(o), count(o));
+			}
+			else if (crosses(o)) {
+				copy(o);
+			}
 			o.xltype = xltypeNil;
 		}
 		OPER& operator=(OPER&& o) noexcept
 		{
 			if (this != &o) {
 				dealloc();
-				xltype = std::exchange(o.xltype, xltypeNil);
-				val = o.val;
+				if (isPooled(o) || isLocal(o)) {
+					alloc(Str(o), count(o));
+				}
+				else if (crosses(o)) {
+					copy(o);
+				}
+				else {
+					xltype = o.xltype;
+					val = o.val;
+				}
+				o.xltype = xltypeNil;
 			}
 
 			return *this;
@@ -175,10 +211,22 @@ namespace xll {
 		constexpr explicit OPER(const XCHAR* str)
 			: OPER(str, str ? len(str) : 0)
 		{ }
-		// utf8::mbstowcs calls new wchar_t[].
+		// Convert from UTF-8.
 		explicit OPER(const char* str)
-			: XLOPER12{ .val = {.str = utf8::mbstowcs(str)}, .xltype = xltypeStr }
-		{ }
+		{
+			const int n = str ? static_cast<int>(strlen(str)) : 0;
+			const int wn = n ? utf8::wcslen(str, n) : 0;
+			if ((n && !wn) || wn > 0x7FFF) {
+				xltype = xltypeErr;
+				val.err = xlerrValue;
+			}
+			else {
+				alloc(nullptr, static_cast<XCHAR>(wn));
+				if (wn && isStr(*this)) {
+					utf8::mbstowcs(str, n, val.str + 1, wn);
+				}
+			}
+		}
 		constexpr OPER(const std::wstring_view& str)
 			: OPER(str.data(), static_cast<XCHAR>(str.size()))
 		{ }
@@ -350,12 +398,55 @@ namespace xll {
 			if (r * c == size(*this)) {
 				return reshape(r, c);
 			}
+			if (!isMulti(*this) || r * c == 0) {
+				OPER o(std::move(*this));
+				alloc(r, c, nullptr);
+				for (int i = 0; i < (std::min)(r * c, size(o)); ++i) {
+					operator[](i) = std::move(o[i]);
+				}
+
+				return *this;
+			}
 
-			OPER o(*this);
-			dealloc();
-			alloc(r, c, nullptr);
-			for (int i = 0; i < (std::min)(r * c, size(o)); ++i) {
-				operator[](i) = o[i];
+			const int n = size(*this);
+			if (r * c < n) {
+				OPER* a = static_cast<OPER*>(Multi(*this));
+				free_nested(a + r * c, n - r * c);
+				std::destroy(a + r * c, a + n);
+				std::uninitialized_default_construct(a + r * c, a + n);
+			}
+			else if (r * c > capacity()) {
+				grow(r * c);
+			}
+			val.array.rows = r;
+			val.array.columns = c;
+
+			return *this;
+		}
+
+		// Number of elements that can be held without reallocating.
+		int capacity() const noexcept
+		{
+			return isMulti(*this) && val.array.lparray ? header().capacity : size(*this);
+		}
+		// Make room for at least n elements.
+		// An empty multi with capacity has no rows and should not be returned to Excel.
+		OPER& reserve(int n)
+		{
+			if (n > capacity()) {
+				if (!isMulti(*this)) {
+					if (size(*this) == 0) {
+						dealloc();
+						xltype = xltypeMulti;
+						val.array.lparray = multi_alloc(n);
+						val.array.rows = 0;
+						val.array.columns = 0;
+
+						return *this;
+					}
+					enlist();
+				}
+				grow(n);
 			}
 
 			return *this;
@@ -436,9 +527,9 @@ namespace xll {
 		OPER& enlist()
 		{
 			if (!isMulti(*this)) {
-				OPER o(*this);
-				dealloc();
-				alloc(1, 1, &o);
+				OPER o(std::move(*this));
+				alloc(1, 1, nullptr);
+				operator[](0) = std::move(o);
 			}
 
 			return *this;
@@ -449,67 +540,174 @@ namespace xll {
 			if (size(x) == 0) {
 				return *this;
 			}
-			if (size(*this) == 0) {
-				return operator=(x);
+			if (&x == this || contains(&x) || (isMulti(x) && Multi(x) == Multi(*this))) {
+				return vstack(OPER(x));
 			}
-			if (columns(*this) != columns(x)) {
-				return operator=(ErrValue);
+			if (!stack(x)) {
+				return *this;
 			}
-			if (!isMulti(*this)) {
-				enlist();
+
+			OPER* a = static_cast<OPER*>(Multi(*this));
+			const XLOPER12* b = xll::begin(x);
+			for (int i = 0; i < size(x); ++i) {
+				a[size(*this) + i] = b[i];
+			}
+			val.array.rows += rows(x);
+
+			return *this;
+		}
+		// Move elements of x.
+		OPER& vstack(OPER&& x)
+		{
+			if (size(x) == 0) {
+				return *this;
+			}
+			if (contains(&x)) {
+				return vstack(OPER(std::move(x))); // grow would invalidate x
+			}
+			if (size(*this) == 0 && capacity() < size(x)) {
+				return operator=(std::move(x));
+			}
+			if (!stack(x)) {
+				return *this;
 			}
 
-			int n = size(*this);
-			OPER o(rows(*this) + rows(x), columns(*this), nullptr);
+			const int n = size(x); // x[0] is x if x is not a multi
+			OPER* a = static_cast<OPER*>(Multi(*this));
 			for (int i = 0; i < n; ++i) {
-				o[i] = operator[](i);
+				a[size(*this) + i] = std::move(x[i]);
 			}
+			val.array.rows += n / columns(*this);
+			adopt_nested(x);
+
+			return *this;
+		}
+		// Transpose in place without calling Excel.
+		OPER& transpose()
+		{
 			if (!isMulti(*this)) {
-				o[n] = x;
+				return *this;
 			}
-			else {
-				for (int i = 0; i < size(x); ++i) {
-					o[size(*this) + i] = x.val.array.lparray[i];
+
+			const int r = rows(*this);
+			const int c = columns(*this);
+			if (r > 1 && c > 1) {
+				// OPERs are trivially relocatable
+				XLOPER12* a = Multi(*this);
+				const auto b = std::make_unique_for_overwrite<XLOPER12[]>(static_cast<size_t>(r) * c);
+				constexpr int tile = 16; // 2 * 16 * 16 * 24 bytes fits in L1
+				for (int i0 = 0; i0 < r; i0 += tile) {
+					for (int j0 = 0; j0 < c; j0 += tile) {
+						for (int i = i0; i < (std::min)(i0 + tile, r); ++i) {
+							for (int j = j0; j < (std::min)(j0 + tile, c); ++j) {
+								b[static_cast<size_t>(j) * r + i] = a[static_cast<size_t>(i) * c + j];
+							}
+						}
+					}
 				}
+				std::memcpy(a, b.get(), static_cast<size_t>(r) * c * sizeof(XLOPER12));
+				relocate(a, r * c, a, a + r * c);
 			}
-			std::swap(*this, o);
+			val.array.rows = c;
+			val.array.columns = r;
 
 			return *this;
 		}
-		OPER& transpose()
+
+		// Append columns of x.
+		OPER& hstack(const XLOPER12& x)
 		{
-			if (isMulti(*this)) {
-				XLOPER12 o;
-				int ret = ::Excel12(xlfTranspose, &o, 1, this);
-				if (ret == xlretSuccess) {
-					operator=(o);
-					::Excel12(xlFree, 0, 1, &o);
+			if (size(x) == 0) {
+				return *this;
+			}
+			if (&x == this || contains(&x) || (isMulti(x) && Multi(x) == Multi(*this))) {
+				return hstack(OPER(x));
+			}
+			if (!interleave(x)) {
+				return *this;
+			}
+
+			const int r = rows(*this);
+			const int c = columns(*this);
+			const int cx = columns(x);
+			const XLOPER12* b = xll::begin(x);
+			for (int i = 0; i < r; ++i) {
+				for (int j = 0; j < cx; ++j) {
+					operator()(i, c - cx + j) = b[i * cx + j];
 				}
 			}
 
 			return *this;
 		}
-		OPER& hstack(const XLOPER12& x)
+		// Move elements of x.
+		OPER& hstack(OPER&& x)
 		{
-			// Not efficient.
-			OPER x_(*this);
-			x_.transpose();
-			OPER _x(x);
-			_x.transpose();
-			vstack(_x);
-			x_.transpose();
-			std::swap(*this, x_);
+			if (size(x) == 0) {
+				return *this;
+			}
+			if (size(*this) == 0) {
+				return operator=(std::move(x));
+			}
+			if (contains(&x)) {
+				return hstack(OPER(std::move(x))); // interleave would invalidate x
+			}
+			if (!interleave(x)) {
+				return *this;
+			}
+
+			const int r = rows(*this);
+			const int c = columns(*this);
+			const int cx = columns(x); // x[0] is x if x is not a multi
+			for (int i = 0; i < r; ++i) {
+				for (int j = 0; j < cx; ++j) {
+					operator()(i, c - cx + j) = std::move(x[i * cx + j]);
+				}
+			}
+			adopt_nested(x);
 
 			return *this;
 		}
 
-		// Append single item to row or column vector
+		// Take over the nested handles of x after moving its elements into this multi.
+		// append moves a multi as one element so its handles go with it.
+		void adopt_nested(OPER& x)
+		{
+			if (x.xltype == xltypeMulti && xltype == xltypeMulti) {
+				header().handles += std::exchange(x.header().handles, 0);
+			}
+		}
+
+		// Replace element oi of this multi with a handle to po owned by this multi.
+		OPER& nest(OPER& oi, OPER* po)
+		{
+			ensure(isMulti(*this) && begin() <= &oi && &oi < end());
+
+			oi = handles::insert(po);
+			++header().handles;
+
+			return oi;
+		}
+
+		// Append single item to row or column vector.
+		// Capacity grows geometrically so appending is amortized O(1).
 		OPER& append(const XLOPER12& x)
+		{
+			return append(OPER(x));
+		}
+		OPER& append(OPER&& x)
 		{
 			if (size(*this) == 0) {
-				operator=(x);
+				if (!isMulti(*this) || isMulti(x)) {
+					operator=(std::move(x));
 
-				return enlist();
+					return enlist();
+				}
+				// empty multi with capacity
+				val.array.rows = 1;
+				val.array.columns = 1;
+				operator[](0) = std::move(x);
+
+				return *this;
 			}
 			if (!isMulti(*this)) {
 				enlist();
@@ -517,68 +715,309 @@ namespace xll {
 			if (rows(*this) != 1 && columns(*this) != 1) {
 				return operator=(ErrValue);
 			}
-			int n = size(*this);
-			OPER o(1, n + 1);
-			for (int i = 0; i < n; ++i) {
-				o[i] = operator[](i);
-			}
-			o[n] = x;
 
-			std::swap(*this, o);	
-			if (rows(*this) != 1) {
-				std::swap(val.array.rows, val.array.columns);
+			const int n = size(*this);
+			OPER o(std::move(x)); // x might be an element of this
+			if (n == capacity()) {
+				grow(2 * n);
+			}
+			operator[](n) = std::move(o);
+			if (rows(*this) == 1) {
+				++val.array.columns;
+			}
+			else {
+				++val.array.rows;
 			}
 
 			return *this;
 		}
 
+		// Strings with at most local_max characters are stored in the OPER.
+		static constexpr XCHAR local_max = static_cast<XCHAR>((sizeof(XLOPER12::val) - sizeof(XCHAR*)) / sizeof(XCHAR) - 2);
+		static_assert(local_max > 0);
+
 	private:
+		static bool isPooled(const XLOPER12& x) noexcept
+		{
+			return x.xltype == xltypeStr && storage(x) == str_storage::pool;
+		}
+		static bool isLocal(const XLOPER12& x) noexcept
+		{
+			return x.xltype == xltypeStr && x.val.str == local(x) + 1;
+		}
+		// Storage tag, count, and characters of a local string.
+		static XCHAR* local(XLOPER12& x) noexcept
+		{
+			return reinterpret_cast<XCHAR*>(&x.val.str + 1);
+		}
+		static const XCHAR* local(const XLOPER12& x) noexcept
+		{
+			return reinterpret_cast<const XCHAR*>(&x.val.str + 1);
+		}
+		// Elements a[0], ..., a[n-1] were moved with memcpy from the block [first, last).
+		// Local strings still point into the block, point them back at their own element.
+		static void relocate(XLOPER12* a, int n, const XLOPER12* first, const XLOPER12* last) noexcept
+		{
+			const auto lo = reinterpret_cast<uintptr_t>(first);
+			const auto hi = reinterpret_cast<uintptr_t>(last);
+			for (int i = 0; i < n; ++i) {
+				if (a[i].xltype == xltypeStr) {
+					const auto p = reinterpret_cast<uintptr_t>(a[i].val.str);
+					if (lo <= p && p < hi) {
+						a[i].val.str = local(a[i]) + 1;
+					}
+				}
+			}
+		}
+
+		// Moving o here would take its memory into or out of an arena.
+		bool crosses(const OPER& o) const noexcept
+		{
+			bool from;
+			if (o.xltype == xltypeStr) {
+				from = storage(o) == str_storage::arena;
+			}
+			else if (o.xltype == xltypeMulti) {
+				from = o.header().arena;
+			}
+			else {
+				return false;
+			}
+
+			return from != (arena::of(this) != nullptr);
+		}
+		// Copy o here, take its nested handles, and free it.
+		void copy(OPER& o)
+		{
+			alloc(static_cast<const XLOPER12&>(o));
+			adopt_nested(o);
+			o.dealloc();
+		}
+
+		// p points into the elements of this multi.
+		bool contains(const XLOPER12* p) const
+		{
+			return isMulti(*this) && Multi(*this) <= p && p < Multi(*this) + capacity();
+		}
+
+		// Prepare to hstack x by spreading the rows of this apart in place.
+		// Return false if x was assigned or an error occured.
+		bool interleave(const XLOPER12& x)
+		{
+			if (size(*this) == 0) {
+				operator=(x);
+
+				return false;
+			}
+			if (rows(*this) != rows(x)) {
+				operator=(ErrValue);
+
+				return false;
+			}
+			if (!isMulti(*this)) {
+				enlist();
+			}
+
+			const int r = rows(*this);
+			const int c = columns(*this);
+			const int cx = columns(x);
+			if (r * (c + cx) > capacity()) {
+				grow((std::max)(r * (c + cx), 2 * capacity()));
+			}
+			XLOPER12* a = Multi(*this);
+			// last row first so rows are not overwritten before they move
+			for (int i = r - 1; i >= 0; --i) {
+				std::memmove(a + i * (c + cx), a + i * c, c * sizeof(XLOPER12));
+				for (int j = 0; j < cx; ++j) {
+					a[i * (c + cx) + c + j] = Nil;
+				}
+			}
+			relocate(a, r * (c + cx), a, a + capacity());
+			val.array.columns = c + cx;
+
+			return true;
+		}
+
+		// Prepare to vstack x. Return false if x was assigned or an error occured.
+		bool stack(const XLOPER12& x)
+		{
+			if (size(*this) == 0 && !(isMulti(*this) && capacity() >= size(x))) {
+				operator=(x);
+
+				return false;
+			}
+			if (size(*this) != 0 && columns(*this) != columns(x)) {
+				operator=(ErrValue);
+
+				return false;
+			}
+			if (!isMulti(*this)) {
+				enlist();
+			}
+			if (size(*this) == 0) {
+				val.array.columns = columns(x);
+			}
+
+			const int n = size(*this) + size(x);
+			if (n > capacity()) {
+				grow((std::max)(n, 2 * capacity()));
+			}
+
+			return true;
+		}
+
+		// Relocate elements to a block holding cap elements.
+		void grow(int cap)
+		{
+			multi_header& h = header();
+			ensure(cap >= h.capacity);
+
+			OPER* a = static_cast<OPER*>(val.array.lparray);
+			OPER* b = multi_alloc(cap, h.chars);
+			multi_header& h_ = *reinterpret_cast<multi_header*>(static_cast<XLOPER12*>(b) - 1);
+			h_.handles = h.handles;
+			// OPERs are trivially relocatable
+			std::memcpy(static_cast<XLOPER12*>(b), static_cast<XLOPER12*>(a), h.capacity * sizeof(XLOPER12));
+			relocate(b, h.capacity, a, a + h.capacity);
+			if (h.chars) {
+				const XCHAR* pool = reinterpret_cast<const XCHAR*>(static_cast<XLOPER12*>(a) + h.capacity);
+				XCHAR* pool_ = reinterpret_cast<XCHAR*>(static_cast<XLOPER12*>(b) + cap);
+				std::copy_n(pool, h.chars, pool_);
+				for (int i = 0; i < h.capacity; ++i) {
+					if (isPooled(b[i])) {
+						b[i].val.str = pool_ + (b[i].val.str - pool);
+					}
+				}
+			}
+			multi_release(a);
+			val.array.lparray = b;
+		}
+
+		// Free nested handles owned by this multi in a[0], ..., a[n-1].
+		void free_nested(OPER* a, int n)
+		{
+			multi_header& h = header();
+			for (int i = 0; h.handles && i < n; ++i) {
+				if (a[i].xltype == xltypeNum) {
+					OPER* po = handles::find(a[i].val.num);
+					if (po) {
+						handles::erase(a[i].val.num);
+						delete po;
+						--h.handles;
+					}
+				}
+			}
+		}
+
 		void dealloc()
 		{
 			// xltype & xlbitDLLFree is freed when xlAutoFree12 is called.
 			if (xltype & xlbitXLFree) {
 				xltype &= ~xlbitXLFree;
-				::Excel12v(xlFree, 0, 1, (LPXLOPER12*)this);
+				LPXLOPER12 px = this;
+				::Excel12v(xlFree, 0, 1, &px);
 			}
 			else if (xltype == xltypeStr) {
-				delete[] val.str;
+				if (storage(*this) == str_storage::heap) {
+					delete[] (val.str - 1);
+				}
 			}
 			else if (xltype == xltypeMulti) {
-				for (auto& o : span(*this)) {
-					static_cast<OPER&>(o).dealloc();
-				}
-				delete[] static_cast<OPER*>(Multi(*this));
+				OPER* a = static_cast<OPER*>(Multi(*this));
+				// Only multis returned by compress own nested handles.
+				free_nested(a, size(*this));
+				multi_free(a, header().capacity);
 			}
 			else if (xltype == xltypeBigData) {
 				if (count(*this)) {
 					delete[] BigData(*this);
 				}
 			}
-			else if (xltype == xltypeNum) {
-				OPER* po = handles::find(val.num);
-				if (po) {
-					po->dealloc();
-				}
+			else if (xltype == xltypeRef) {
+				::operator delete(val.mref.lpmref);
 			}
 
 			xltype = xltypeNil;
 		}
 
+		// Bookkeeping stored in the slot in front of lparray of multis allocated by OPER.
+		// Elements past rows*columns are Nil.
+		struct multi_header {
+			int capacity; // number of elements allocated
+			int handles;  // number of elements that are nested handles owned by the multi
+			size_t chars; // number of XCHARs in the pool following the elements
+			bool arena;   // allocated in an arena
+		};
+		static_assert(sizeof(multi_header) <= sizeof(XLOPER12));
+
+		multi_header& header() const
+		{
+			return *reinterpret_cast<multi_header*>(val.array.lparray - 1);
+		}
+		// Allocate header, n default constructed elements, and a trailing pool of chars.
+		// In the arena if this OPER lives in it.
+		OPER* multi_alloc(int n, size_t chars = 0) const
+		{
+			const size_t bytes = sizeof(XLOPER12) * (1 + static_cast<size_t>(n)) + sizeof(XCHAR) * chars;
+			arena* pa = arena::of(this);
+			XLOPER12* p = static_cast<XLOPER12*>(pa ? pa->allocate(bytes, alignof(XLOPER12)) : ::operator new(bytes));
+			new (p) multi_header{ .capacity = n, .handles = 0, .chars = chars, .arena = pa != nullptr };
+			OPER* a = static_cast<OPER*>(p + 1);
+			std::uninitialized_default_construct_n(a, n);
+
+			return a;
+		}
+		// Free the block of a without destroying elements.
+		static void multi_release(OPER* a)
+		{
+			XLOPER12* p = static_cast<XLOPER12*>(a) - 1;
+			if (!reinterpret_cast<multi_header*>(p)->arena) {
+				::operator delete(p);
+			}
+		}
+		static void multi_free(OPER* a, int n)
+		{
+			std::destroy_n(a, n);
+			multi_release(a);
+		}
+
 		// Str
-		constexpr void alloc(const XCHAR* str, XCHAR len)
+		// Storage for a string of len characters preceded by its storage tag.
+		// In the arena if x lives in it.
+		static constexpr XCHAR* str_alloc(XLOPER12& x, XCHAR len)
 		{
-			xltype = xltypeStr;
-			val.str = new XCHAR[1 + static_cast<size_t>(len)];
-			if (!val.str) {
-				xltype = xltypeErr;
-				val.err = xlerrNA;
+			const size_t n = 2 + static_cast<size_t>(len);
+			XCHAR* p = nullptr;
+			str_storage s = str_storage::heap;
+			if consteval {
+				p = new XCHAR[n];
 			}
 			else {
-				val.str[0] = len;
-				if (str && len) {
-					std::copy_n(str, len, val.str + 1);
+				if (len <= local_max) {
+					p = local(x);
+					s = str_storage::local;
+				}
+				else if (arena* pa = arena::of(&x)) {
+					p = static_cast<XCHAR*>(pa->allocate(n * sizeof(XCHAR), alignof(XCHAR)));
+					s = str_storage::arena;
+				}
+				else {
+					p = new XCHAR[n];
 				}
 			}
+			p[0] = static_cast<XCHAR>(s);
+
+			return p;
+		}
+		// Str
+		constexpr void alloc(const XCHAR* str, XCHAR len)
+		{
+			xltype = xltypeStr;
+			val.str = str_alloc(*this, len) + 1;
+			val.str[0] = len;
+			if (str && len) {
+				std::copy_n(str, len, val.str + 1);
+			}
 		}
 		// Multi
 		constexpr void alloc(int r, int c, const XLOPER12* a)
@@ -588,10 +1027,43 @@ namespace xll {
 			val.array.columns = c;
 			val.array.lparray = nullptr;
 			if (size(*this)) {
-				val.array.lparray = new OPER[size(*this)];
-				if (a) {
-					for (int i = 0; i < r * c; ++i) {
-						new (val.array.lparray + i) OPER(a[i]);
+				const int n = size(*this);
+				// Sizing pass: long strings go in the pool, nested allocations do not.
+				bool flat = a != nullptr;
+				size_t chars = 0;
+				for (int i = 0; flat && i < n; ++i) {
+					if (type(a[i]) == xltypeStr && a[i].val.str[0] > local_max) {
+						chars += 2 + static_cast<size_t>(a[i].val.str[0]);
+					}
+					else if (type(a[i]) != xltypeStr && isAlloc(a[i])) {
+						flat = false;
+					}
+				}
+				if (flat) {
+					val.array.lparray = multi_alloc(n, chars);
+					XLOPER12* lp = val.array.lparray;
+					std::memcpy(lp, a, n * sizeof(XLOPER12));
+					XCHAR* pool = reinterpret_cast<XCHAR*>(lp + n);
+					for (int i = 0; i < n; ++i) {
+						lp[i].xltype = type(lp[i]);
+						if (lp[i].xltype == xltypeStr && a[i].val.str[0] <= local_max) {
+							static_cast<OPER*>(lp + i)->alloc(a[i].val.str + 1, a[i].val.str[0]);
+						}
+						else if (lp[i].xltype == xltypeStr) {
+							const XCHAR len = a[i].val.str[0];
+							pool[0] = static_cast<XCHAR>(str_storage::pool);
+							std::copy_n(a[i].val.str, 1 + len, pool + 1);
+							lp[i].val.str = pool + 1;
+							pool += 2 + static_cast<size_t>(len);
+						}
+					}
+				}
+				else {
+					val.array.lparray = multi_alloc(n);
+					if (a) {
+						for (int i = 0; i < n; ++i) {
+							new (val.array.lparray + i) OPER(a[i]);
+						}
 					}
 				}
 			}
@@ -610,6 +1082,17 @@ namespace xll {
 				std::copy_n(data, len, val.bigdata.h.lpbData);
 			}
 		}
+		// Areas of a reference. Excel frees its own with xlFree.
+		void alloc(const XLMREF12* m, IDSHEET id)
+		{
+			const WORD n = m ? m->count : 0;
+			auto p = static_cast<XLMREF12*>(::operator new(sizeof(XLMREF12) + (n ? n - 1 : 0) * sizeof(XLREF12)));
+			p->count = n;
+			std::copy_n(m ? m->reftbl : nullptr, n, p->reftbl);
+			xltype = xltypeRef;
+			val.mref.lpmref = p;
+			val.mref.idSheet = id;
+		}
 		constexpr void alloc(const XLOPER12& x)
 		{
 			xltype = type(x);
@@ -618,7 +1101,12 @@ namespace xll {
 				alloc(Str(x), count(x));
 				break;
 			case xltypeMulti:
-				alloc(rows(x), columns(x), Multi(x));
+				if (size(x) == 0) { // empty multi with capacity
+					xltype = xltypeNil;
+				}
+				else {
+					alloc(rows(x), columns(x), Multi(x));
+				}
 				break;
 			case xltypeBigData:
 				if (count(x)) {
@@ -628,6 +1116,14 @@ namespace xll {
 					val.bigdata.h.hdata = x.val.bigdata.h.hdata;
 				}
 				break;
+			case xltypeRef:
+				if consteval {
+					val = x.val;
+				}
+				else {
+					alloc(x.val.mref.lpmref, x.val.mref.idSheet);
+				}
+				break;
 			default:
 				val = x.val;
 			}
@@ -635,6 +1131,38 @@ namespace xll {
 		}
 	};
 
+	// OPER built in the arena of the calling thread.
+	// Return it from thread-safe functions without xlbitDLLFree. It is valid until calculation ends.
+	// Values assigned to it or its elements on this thread are copied into the arena.
+	// Moving them out to any other OPER copies them to the heap.
+	template<class... Ts>
+	inline OPER* arena_oper(Ts&&... ts)
+	{
+		arena& a = arena::local();
+		a.refresh();
+		void* p = a.allocate(sizeof(OPER), alignof(OPER));
+
+		return new (p) OPER(std::forward<Ts>(ts)...);
+	}
+
+	// Ring of N result OPERs per thread for each Tag.
+	// Excel copies a result before the thread calls the function again so a
+	// slot is only overwritten after N more calls on the same thread.
+	template<class Tag, size_t N = 4>
+	inline OPER& result_slot()
+	{
+		thread_local OPER slot[N];
+		thread_local size_t i = 0;
+
+		OPER& o = slot[i];
+		i = (i + 1) % N;
+
+		return o;
+	}
+
+// Use XLL_RESULT(o) instead of static OPER o in functions registered ThreadSafe().
+#define XLL_RESULT(o) struct o##_result_tag; xll::OPER& o = xll::result_slot<o##_result_tag>()
+
 	// Replace nested OPER with safe handles.
 	inline OPER compress(const OPER& o)
 	{
@@ -645,7 +1173,7 @@ namespace xll {
 		OPER o_(o);
 		for (OPER& oi : o_) {
 			if (isMulti(oi)) {
-				oi = handles::insert(new OPER(compress(oi)));
+				o_.nest(oi, new OPER(compress(oi)));
 			}
 		}
 
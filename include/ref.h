@@ -1,9 +1,13 @@
 // ref.h - REF class to construct XLREF12 type
 // Copyright (c) KALX, LLC. All rights reserved. No warranty made.
 #pragma once
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #define NOMINMAX
 #include <Windows.h>
+#else
+#include "win.h"
+#endif
 extern "C" {
 #include "XLCALL.H" // NOLINT
 }
@@ -1,6 +1,7 @@
 // register.h - Excel function and macro registration.
 // Copyright (c) KALX, LLC. All rights reserved. No warranty made.
 #pragma once
+#include "alert.h"
 #include "args.h"
 
 namespace xll {
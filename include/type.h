@@ -1,6 +1,7 @@
 // type.h - Type s slowly into the active cell.
 #pragma once
 #include "xll.h"
+#include "macrofun.h"
 
 void DoEvents(int ms = 0);
 
@@ -9,9 +10,8 @@ namespace xll {
 	// Pause in milliseconds between typing characters and waiting after typing.
 	inline void Type(const char* s, int pause, int wait)
 	{
+		Suspend suspend(true); // keep screen updating on
 		OPER ac = Excel(xlfActiveCell);
-		OPER ct = Excel(xlfGetDocument, 14); // calculation type
-		Excel(xlcOptionsCalculation, 3); // manual calc
 
 		OPER t(s);
 		size_t n = strlen(s);
@@ -29,6 +29,5 @@ namespace xll {
 		if (t.val.str[0] && t.val.str[1] == '=') {
 			Excel(xlcFormula, t, ac);
 		}
-		Excel(xlcOptionsCalculation, ct);
 	}
 } // namespace xll
\ No newline at end of file
@@ -1,22 +1,103 @@
 ﻿// utf8.h - utf8 to wide character string conversion
 // Copyright (c) KALX, LLC. All rights reserved. No warranty made.
 #pragma once
+#ifdef _WIN32
 #include <stringapiset.h>
-#include <string_view>
+#endif
+#include <climits>
+#include <cstring>
+#include <cwchar>
 #include <memory>
+#include <string>
+#include <string_view>
 
 namespace utf8 {
 
+#ifndef _WIN32
+	// Conversions between UTF-8 and the UTF-32 wchar_t used off Windows.
+	// Same conventions as MultiByteToWideChar and WideCharToMultiByte with CP_UTF8:
+	// a length of -1 includes the null terminator, a null output returns the required size,
+	// an output that is too small returns 0, and malformed input becomes U+FFFD.
+	inline int to_wide(const char* s, int n, wchar_t* ws, int wn)
+	{
+		if (n == -1) {
+			n = static_cast<int>(std::strlen(s)) + 1;
+		}
+		const auto p = reinterpret_cast<const unsigned char*>(s);
+		int k = 0;
+		for (int i = 0; i < n; ++k) {
+			char32_t c = p[i++];
+			// number of continuation bytes
+			int m = c < 0x80 ? 0 : c < 0xC2 ? -1 : c < 0xE0 ? 1 : c < 0xF0 ? 2 : c < 0xF5 ? 3 : -1;
+			if (m < 0) {
+				c = 0xFFFD;
+			}
+			else if (m > 0) {
+				c &= 0x3F >> m;
+				int j = 0;
+				for (; j < m && i < n && (p[i] & 0xC0) == 0x80; ++j) {
+					c = (c << 6) | (p[i++] & 0x3F);
+				}
+				if (j < m || (m == 2 && (c < 0x800 || (c >= 0xD800 && c < 0xE000))) || (m == 3 && (c < 0x10000 || c > 0x10FFFF))) {
+					c = 0xFFFD;
+				}
+			}
+			if (ws) {
+				if (k == wn) {
+					return 0;
+				}
+				ws[k] = static_cast<wchar_t>(c);
+			}
+		}
+
+		return k;
+	}
+	inline int from_wide(const wchar_t* ws, int wn, char* s, int n)
+	{
+		if (wn == -1) {
+			wn = static_cast<int>(std::wcslen(ws)) + 1;
+		}
+		int k = 0;
+		for (int i = 0; i < wn; ++i) {
+			auto c = static_cast<char32_t>(ws[i]);
+			if (c > 0x10FFFF || (c >= 0xD800 && c < 0xE000)) {
+				c = 0xFFFD;
+			}
+			const int m = c < 0x80 ? 1 : c < 0x800 ? 2 : c < 0x10000 ? 3 : 4;
+			if (s) {
+				if (k + m > n) {
+					return 0;
+				}
+				s[k] = static_cast<char>(m == 1 ? c : ((0xF00 >> m) & 0xFF) | (c >> (6 * (m - 1))));
+				for (int j = 1; j < m; ++j) {
+					s[k + j] = static_cast<char>(0x80 | ((c >> (6 * (m - 1 - j))) & 0x3F));
+				}
+			}
+			k += m;
+		}
+
+		return k;
+	}
+#endif // _WIN32
+
 	// Wide character string size of multi-byte character string.
 	// Default to null terminated string.
 	inline int wcslen(const char* s, int n = -1)
 	{
+#ifdef _WIN32
 		return MultiByteToWideChar(CP_UTF8, 0, s, n, nullptr, 0);
+#else
+		return to_wide(s, n, nullptr, 0);
+#endif
 	}
 	// Fill ws with wide character string from multi-byte character string.
 	inline int mbstowcs(const char* s, int n, wchar_t* ws, int wn)
 	{
+#ifdef _WIN32
 		return MultiByteToWideChar(CP_UTF8, 0, s, n, ws, wn);
+#else
+		return to_wide(s, n, ws, wn);
+#endif
 	}
 
 	// Multi-byte character string to counted wide character string allocated by new[].
@@ -76,12 +157,20 @@ namespace utf8 {
 	// Default to null terminated string.
 	inline int mbslen(const wchar_t* ws, int wn = -1)
 	{
+#ifdef _WIN32
 		return WideCharToMultiByte(CP_UTF8, 0, ws, wn, nullptr, 0, 0, 0);
+#else
+		return from_wide(ws, wn, nullptr, 0);
+#endif
 	}
 	// Fill ws with wide character string from multi-byte character string.
 	inline int wcstombs(const wchar_t* ws, int wn, char* s, int n)
 	{
+#ifdef _WIN32
 		return WideCharToMultiByte(CP_UTF8, 0, ws, wn, s, n, 0, 0);
+#else
+		return from_wide(ws, wn, s, n);
+#endif
 	}
 
 
@@ -0,0 +1,51 @@
+// win.h - Windows types and calling conventions used by XLCALL.H on other platforms.
+// Copyright (c) KALX, LLC. All rights reserved. No warranty made.
+// XCHAR is wchar_t, which is 32 bits on Linux. There is no Excel on the other
+// side, so the layout only has to agree with the stand-in host in host.h.
+#pragma once
+#ifdef _WIN32
+#error win.h is for non-Windows builds
+#endif
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+typedef int32_t INT32;
+typedef int32_t LONG;
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef uint32_t UINT;
+typedef uintptr_t DWORD_PTR;
+typedef wchar_t WCHAR;
+typedef char* LPSTR;
+typedef const char* LPCSTR;
+typedef wchar_t* LPWSTR;
+typedef const wchar_t* LPCWSTR;
+typedef void VOID;
+typedef void* HANDLE;
+typedef void* HWND;
+typedef void* HMODULE;
+typedef struct tagPOINT {
+	LONG x;
+	LONG y;
+} POINT;
+
+#define FALSE 0
+#define TRUE 1
+
+#define MB_ICONERROR 0x10
+#define MB_ICONWARNING 0x30
+#define MB_ICONINFORMATION 0x40
+
+#define pascal
+#define PASCAL
+#define WINAPI
+#define CALLBACK
+#define __stdcall
+#define _cdecl
+#define __cdecl
+#define __forceinline inline
+#ifndef __declspec
+#define __declspec(x) __attribute__((visibility("default")))
+#endif
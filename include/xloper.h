@@ -2,6 +2,8 @@
 // Copyright (c) KALX, LLC. All rights reserved. No warranty made.
 #pragma once
 #include <iostream>
+#include <limits>
+#include <span>
 #include <string_view>
 #include "ref.h"
 #include "utf8.h"
@@ -0,0 +1,35 @@
+// calculation.cpp - Work done when Excel finishes calculating.
+// Copyright (c) KALX, LLC. All rights reserved. No warranty made.
+// No worksheet function is running so per-thread arenas can be released
+// and objects erased from handle tables deleted. They are also deleted
+// when the add-in closes.
+#include "xll.h"
+
+using namespace xll;
+
+AddIn xai_calculation_ended(Macro(L"xll_calculation_ended", L"XLL.CALCULATION.ENDED").Hide());
+int WINAPI xll_calculation_ended()
+{
+#pragma XLLEXPORT
+	arena::release();
+	retired::reclaim();
+
+	return Auto<CalculationEnded>::Call();
+}
+
+// Objects retired after the last calculation.
+Auto<Close> xac_retired([]() {
+	retired::reclaim();
+
+	return TRUE;
+});
+
+Auto<OpenAfter> xaoa_calculation_ended([]() {
+	for (int event : { xleventCalculationEnded, xleventCalculationCanceled }) {
+		if (Excel(xlEventRegister, OPER(L"XLL.CALCULATION.ENDED"), OPER(event)) != true) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+});
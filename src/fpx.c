@@ -1,9 +1,28 @@
 // fpx.c - C VLA implementation of the fpx.h interface.
 // Copyright (c) KALX, LLC. All rights reserved. No warranty made.
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include "fpx.h"
 
+// External definitions of the C99 inline functions in fpx.h.
+extern inline int32_t fpx_clamp(int32_t n, int32_t lo, int32_t hi);
+extern inline int32_t fpx_rows(struct fpx* fpx);
+extern inline int32_t fpx_columns(struct fpx* fpx);
+extern inline int32_t fpx_size(struct fpx* fpx);
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__)
+#define FPX_SSE2 1
+#include <emmintrin.h>
+#else
+#define FPX_SSE2 0
+#endif
+
+// Tile edge in doubles. Two 32 x 32 tiles fit in L1.
+#define FPX_TILE 32
+// Rectangular arrays larger than this are transposed through a scratch buffer.
+#define FPX_TRANSPOSE_CYCLES 1024
+
 void swap_double(double* x, double* y) {
 	double t = *x;
 	*x = *y;
@@ -15,9 +34,62 @@ int32_t fpx_index(struct fpx* p, int32_t i, int32_t j)
 	return p->columns * i + j;
 }
 
+// The array of an allocated fpx starts on an FPX_ALIGN byte boundary.
+// The byte before the header holds the offset from the malloc pointer.
+#define FPX_ALIGN 64
+#define FPX_HEADER offsetof(struct fpx, array)
+
+static size_t fpx_bytes(size_t n)
+{
+	return FPX_ALIGN + FPX_HEADER + (n ? n : 1) * sizeof(double);
+}
+
+// Header position in the block at raw that aligns the array.
+static unsigned char* fpx_aligned(unsigned char* raw)
+{
+	uintptr_t a = ((uintptr_t)raw + 1 + FPX_HEADER + FPX_ALIGN - 1) & ~(uintptr_t)(FPX_ALIGN - 1);
+
+	return (unsigned char*)(a - FPX_HEADER);
+}
+
+static unsigned char* fpx_raw(struct fpx* p)
+{
+	return (unsigned char*)p - ((unsigned char*)p)[-1];
+}
+
+// Reallocate to hold n elements keeping the header and the first m elements.
+static struct fpx* fpx_resize(struct fpx* p, size_t n, size_t m)
+{
+	if (!p) {
+		unsigned char* raw = malloc(fpx_bytes(n));
+		if (!raw) {
+			return (struct fpx*)0;
+		}
+		unsigned char* q = fpx_aligned(raw);
+		q[-1] = (unsigned char)(q - raw);
+		((struct fpx*)q)->rows = 0;
+		((struct fpx*)q)->columns = 0;
+
+		return (struct fpx*)q;
+	}
+
+	unsigned char off = ((unsigned char*)p)[-1];
+	unsigned char* raw = realloc(fpx_raw(p), fpx_bytes(n));
+	if (!raw) {
+		return (struct fpx*)0;
+	}
+	unsigned char* q = fpx_aligned(raw);
+	if (q != raw + off) {
+		memmove(q, raw + off, FPX_HEADER + m * sizeof(double));
+	}
+	q[-1] = (unsigned char)(q - raw);
+
+	return (struct fpx*)q;
+}
+
 struct fpx* fpx_malloc(int32_t r, int32_t c)
 {
-	struct fpx* fpx = malloc(sizeof(struct fpx) + (size_t)r * (size_t)c * sizeof(double));
+	struct fpx* fpx = fpx_resize((struct fpx*)0, (size_t)r * (size_t)c, 0);
 
 	if (fpx) {
 		fpx->rows = r;
@@ -29,50 +101,158 @@ struct fpx* fpx_malloc(int32_t r, int32_t c)
 
 struct fpx* fpx_realloc(struct fpx* p, int32_t r, int32_t c)
 {
-	struct fpx* _p = realloc(p, sizeof(struct fpx) + (size_t)r * (size_t)c * sizeof(double));
+	size_t n = (size_t)r * (size_t)c;
+	size_t m = p ? (size_t)fpx_size(p) : 0;
+	struct fpx* _p = fpx_resize(p, n, m < n ? m : n);
 
 	if (_p) {
 		_p->rows = r;
 		_p->columns = c;
 	}
 
-	return _p ? _p : (void*)0;
+	return _p;
+}
+
+struct fpx* fpx_reserve(struct fpx* p, int32_t n)
+{
+	size_t m = p ? (size_t)fpx_size(p) : 0;
+
+	return fpx_resize(p, (size_t)n, m < (size_t)n ? m : (size_t)n);
 }
 
 void fpx_free(struct fpx* p)
 {
-	free(p);
+	if (p) {
+		free(fpx_raw(p));
+	}
 }
 
-// TODO: use dimatcopy
+// Copy the r x c block at a with row stride sa transposed to b with row stride sb.
+static void fpx_transpose_block(int32_t r, int32_t c, const double* a, size_t sa, double* b, size_t sb)
+{
+	int32_t i = 0;
+#if FPX_SSE2
+	for (; i + 1 < r; i += 2) {
+		const double* a0 = a + i * sa;
+		const double* a1 = a0 + sa;
+		int32_t j = 0;
+		for (; j + 1 < c; j += 2) {
+			__m128d x0 = _mm_loadu_pd(a0 + j);
+			__m128d x1 = _mm_loadu_pd(a1 + j);
+			_mm_storeu_pd(b + j * sb + i, _mm_unpacklo_pd(x0, x1));
+			_mm_storeu_pd(b + (j + 1) * sb + i, _mm_unpackhi_pd(x0, x1));
+		}
+		if (j < c) {
+			b[j * sb + i] = a0[j];
+			b[j * sb + i + 1] = a1[j];
+		}
+	}
+#endif
+	for (; i < r; ++i) {
+		for (int32_t j = 0; j < c; ++j) {
+			b[j * sb + i] = a[i * sa + j];
+		}
+	}
+}
+
+void fpx_transpose_copy(int32_t r, int32_t c, const double* a, double* b)
+{
+	for (int32_t i = 0; i < r; i += FPX_TILE) {
+		int32_t ri = r - i < FPX_TILE ? r - i : FPX_TILE;
+		for (int32_t j = 0; j < c; j += FPX_TILE) {
+			int32_t cj = c - j < FPX_TILE ? c - j : FPX_TILE;
+			fpx_transpose_block(ri, cj, a + (size_t)i * c + j, c, b + (size_t)j * r + i, r);
+		}
+	}
+}
+
+// Swap the n x m block at p with the transpose of the m x n block at q.
+static void fpx_swap_block(int32_t n, int32_t m, double* p, double* q, size_t s)
+{
+	for (int32_t i = 0; i < n; ++i) {
+		for (int32_t j = 0; j < m; ++j) {
+			swap_double(p + i * s + j, q + j * s + i);
+		}
+	}
+}
+
+static void fpx_transpose_square(int32_t n, double* a)
+{
+	for (int32_t i = 0; i < n; i += FPX_TILE) {
+		int32_t ni = n - i < FPX_TILE ? n - i : FPX_TILE;
+		double* d = a + (size_t)i * n + i;
+		// diagonal tile
+		for (int32_t k = 0; k < ni; ++k) {
+			for (int32_t l = k + 1; l < ni; ++l) {
+				swap_double(d + k * n + l, d + l * n + k);
+			}
+		}
+		for (int32_t j = i + FPX_TILE; j < n; j += FPX_TILE) {
+			int32_t nj = n - j < FPX_TILE ? n - j : FPX_TILE;
+			fpx_swap_block(ni, nj, a + (size_t)i * n + j, a + (size_t)j * n + i, n);
+		}
+	}
+}
+
+// Element k of the r x c array moves to k*r mod (r*c - 1).
+// Rotate each cycle once, tracking visited elements in the bit set seen.
+// If seen is null then only rotate from the smallest index of each cycle.
+static void fpx_transpose_cycles(int32_t r, int32_t c, double* a, unsigned char* seen)
+{
+	int64_t n1 = (int64_t)r * c - 1;
+
+	for (int64_t s = 1; s < n1; ++s) {
+		int64_t k;
+		if (seen) {
+			if (seen[s >> 3] & (1 << (s & 7))) {
+				continue;
+			}
+		}
+		else {
+			for (k = (s * r) % n1; k > s; k = (k * r) % n1)
+				;
+			if (k != s) {
+				continue;
+			}
+		}
+		double t = a[s];
+		for (k = (s * r) % n1; k != s; k = (k * r) % n1) {
+			swap_double(&t, a + k);
+			if (seen) {
+				seen[k >> 3] |= (unsigned char)(1 << (k & 7));
+			}
+		}
+		a[s] = t;
+	}
+}
+
+// In-place transpose. Always returns fpx.
 struct fpx* fpx_transpose(struct fpx* fpx)
 {
 	int32_t r = fpx_rows(fpx);
 	int32_t c = fpx_columns(fpx);
-	if (r * c <= 1) {
-		return fpx;
-	}
 
 	if (r > 1 && c > 1) {
-		if (r == c) { // in-place transpose if square			
-			for (int32_t i = 0; i < r; ++i) {
-				for (int32_t j = i + 1; j < c; ++j) {
-					swap_double(fpx->array + fpx_index(fpx, i, j), fpx->array + fpx_index(fpx, j, i));
-				}
-			}
+		if (r == c) {
+			fpx_transpose_square(r, fpx->array);
+		}
+		else if (fpx_size(fpx) <= FPX_TRANSPOSE_CYCLES) {
+			unsigned char seen[FPX_TRANSPOSE_CYCLES / 8] = { 0 };
+			fpx_transpose_cycles(r, c, fpx->array, seen);
 		}
 		else {
-			struct fpx* _fpx = fpx_malloc(c, r);
-			if (!_fpx) {
-				return (struct fpx*)0;
+			size_t n = (size_t)r * (size_t)c;
+			double* t = malloc(n * sizeof(double));
+			if (t) {
+				fpx_transpose_copy(r, c, fpx->array, t);
+				memcpy(fpx->array, t, n * sizeof(double));
+				free(t);
 			}
-			for (int32_t i = 0; i < r; ++i) {
-				for (int32_t j = i + 1; j < c; ++j) {
-					swap_double(fpx->array + fpx_index(fpx, i, j), fpx->array + fpx_index(fpx, j, i));
-				}
+			else {
+				unsigned char* seen = calloc(n / 8 + 1, 1);
+				fpx_transpose_cycles(r, c, fpx->array, seen);
+				free(seen);
 			}
-			fpx_free(fpx);
-			fpx = _fpx;
 		}
 	}
 	fpx->rows = c;
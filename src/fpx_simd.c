@@ -0,0 +1,551 @@
+// fpx_simd.c - vector kernels over double arrays with runtime CPU dispatch.
+// Copyright (c) KALX, LLC. All rights reserved. No warranty made.
+// Reductions use several accumulators so results can differ from a
+// left to right loop in the last bits. NaN propagation is unspecified.
+#include <math.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#else
+#include <stdatomic.h>
+#endif
+#include "fpx.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define FPX_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#else
+#define FPX_X86 0
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define FPX_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define FPX_TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define FPX_TARGET_AVX2
+#define FPX_TARGET_AVX512
+#endif
+
+enum { FPX_OP_ADD, FPX_OP_SUB, FPX_OP_MUL, FPX_OP_DIV };
+
+//
+// Scalar
+//
+
+static double sum_scalar(const double* a, int32_t n)
+{
+	double s = 0;
+	for (int32_t i = 0; i < n; ++i) {
+		s += a[i];
+	}
+	return s;
+}
+
+static double dot_scalar(const double* a, const double* b, int32_t n)
+{
+	double s = 0;
+	for (int32_t i = 0; i < n; ++i) {
+		s += a[i] * b[i];
+	}
+	return s;
+}
+
+static double min_scalar(const double* a, int32_t n)
+{
+	double m = INFINITY;
+	for (int32_t i = 0; i < n; ++i) {
+		m = a[i] < m ? a[i] : m;
+	}
+	return m;
+}
+
+static double max_scalar(const double* a, int32_t n)
+{
+	double m = -INFINITY;
+	for (int32_t i = 0; i < n; ++i) {
+		m = a[i] > m ? a[i] : m;
+	}
+	return m;
+}
+
+static void axpy_scalar(double a, const double* x, double* y, int32_t n)
+{
+	for (int32_t i = 0; i < n; ++i) {
+		y[i] += a * x[i];
+	}
+}
+
+static void scale_scalar(double a, double* x, int32_t n)
+{
+	for (int32_t i = 0; i < n; ++i) {
+		x[i] *= a;
+	}
+}
+
+static void op_scalar(int op, const double* x, double* y, int32_t n)
+{
+	switch (op) {
+	case FPX_OP_ADD:
+		for (int32_t i = 0; i < n; ++i) y[i] += x[i];
+		break;
+	case FPX_OP_SUB:
+		for (int32_t i = 0; i < n; ++i) y[i] -= x[i];
+		break;
+	case FPX_OP_MUL:
+		for (int32_t i = 0; i < n; ++i) y[i] *= x[i];
+		break;
+	case FPX_OP_DIV:
+		for (int32_t i = 0; i < n; ++i) y[i] /= x[i];
+		break;
+	}
+}
+
+static void cumsum_scalar(double* a, int32_t n)
+{
+	double s = 0;
+	for (int32_t i = 0; i < n; ++i) {
+		s += a[i];
+		a[i] = s;
+	}
+}
+
+#if FPX_X86
+
+//
+// AVX2
+//
+
+FPX_TARGET_AVX2
+static double hsum_avx2(__m256d v)
+{
+	__m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+	return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+}
+
+FPX_TARGET_AVX2
+static double sum_avx2(const double* a, int32_t n)
+{
+	__m256d s0 = _mm256_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+	int32_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		s0 = _mm256_add_pd(s0, _mm256_loadu_pd(a + i));
+		s1 = _mm256_add_pd(s1, _mm256_loadu_pd(a + i + 4));
+		s2 = _mm256_add_pd(s2, _mm256_loadu_pd(a + i + 8));
+		s3 = _mm256_add_pd(s3, _mm256_loadu_pd(a + i + 12));
+	}
+	for (; i + 4 <= n; i += 4) {
+		s0 = _mm256_add_pd(s0, _mm256_loadu_pd(a + i));
+	}
+	s0 = _mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3));
+
+	return hsum_avx2(s0) + sum_scalar(a + i, n - i);
+}
+
+FPX_TARGET_AVX2
+static double dot_avx2(const double* a, const double* b, int32_t n)
+{
+	__m256d s0 = _mm256_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+	int32_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		s0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), s0);
+		s1 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4), s1);
+		s2 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i + 8), _mm256_loadu_pd(b + i + 8), s2);
+		s3 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i + 12), _mm256_loadu_pd(b + i + 12), s3);
+	}
+	for (; i + 4 <= n; i += 4) {
+		s0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), s0);
+	}
+	s0 = _mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3));
+
+	return hsum_avx2(s0) + dot_scalar(a + i, b + i, n - i);
+}
+
+FPX_TARGET_AVX2
+static double min_avx2(const double* a, int32_t n)
+{
+	__m256d m0 = _mm256_set1_pd(INFINITY), m1 = m0;
+	int32_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		m0 = _mm256_min_pd(m0, _mm256_loadu_pd(a + i));
+		m1 = _mm256_min_pd(m1, _mm256_loadu_pd(a + i + 4));
+	}
+	double m[4];
+	_mm256_storeu_pd(m, _mm256_min_pd(m0, m1));
+	double t = min_scalar(a + i, n - i);
+	for (int k = 0; k < 4; ++k) {
+		t = m[k] < t ? m[k] : t;
+	}
+
+	return t;
+}
+
+FPX_TARGET_AVX2
+static double max_avx2(const double* a, int32_t n)
+{
+	__m256d m0 = _mm256_set1_pd(-INFINITY), m1 = m0;
+	int32_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		m0 = _mm256_max_pd(m0, _mm256_loadu_pd(a + i));
+		m1 = _mm256_max_pd(m1, _mm256_loadu_pd(a + i + 4));
+	}
+	double m[4];
+	_mm256_storeu_pd(m, _mm256_max_pd(m0, m1));
+	double t = max_scalar(a + i, n - i);
+	for (int k = 0; k < 4; ++k) {
+		t = m[k] > t ? m[k] : t;
+	}
+
+	return t;
+}
+
+FPX_TARGET_AVX2
+static void axpy_avx2(double a, const double* x, double* y, int32_t n)
+{
+	__m256d a_ = _mm256_set1_pd(a);
+	int32_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		_mm256_storeu_pd(y + i, _mm256_fmadd_pd(a_, _mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+	}
+	axpy_scalar(a, x + i, y + i, n - i);
+}
+
+FPX_TARGET_AVX2
+static void scale_avx2(double a, double* x, int32_t n)
+{
+	__m256d a_ = _mm256_set1_pd(a);
+	int32_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		_mm256_storeu_pd(x + i, _mm256_mul_pd(a_, _mm256_loadu_pd(x + i)));
+	}
+	scale_scalar(a, x + i, n - i);
+}
+
+FPX_TARGET_AVX2
+static void op_avx2(int op, const double* x, double* y, int32_t n)
+{
+	int32_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m256d x_ = _mm256_loadu_pd(x + i);
+		__m256d y_ = _mm256_loadu_pd(y + i);
+		switch (op) {
+		case FPX_OP_ADD: y_ = _mm256_add_pd(y_, x_); break;
+		case FPX_OP_SUB: y_ = _mm256_sub_pd(y_, x_); break;
+		case FPX_OP_MUL: y_ = _mm256_mul_pd(y_, x_); break;
+		case FPX_OP_DIV: y_ = _mm256_div_pd(y_, x_); break;
+		}
+		_mm256_storeu_pd(y + i, y_);
+	}
+	op_scalar(op, x + i, y + i, n - i);
+}
+
+// Prefix sum of four lanes plus carry from previous block.
+FPX_TARGET_AVX2
+static void cumsum_avx2(double* a, int32_t n)
+{
+	__m256d z = _mm256_setzero_pd();
+	__m256d c = z;
+	int32_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m256d x = _mm256_loadu_pd(a + i);
+		// [x0, x0 + x1, x1 + x2, x2 + x3]
+		x = _mm256_add_pd(x, _mm256_blend_pd(_mm256_permute4x64_pd(x, 0x90), z, 0x1));
+		// [x0, x0 + x1, x0 + x1 + x2, x0 + x1 + x2 + x3]
+		x = _mm256_add_pd(x, _mm256_blend_pd(_mm256_permute4x64_pd(x, 0x40), z, 0x3));
+		x = _mm256_add_pd(x, c);
+		_mm256_storeu_pd(a + i, x);
+		c = _mm256_permute4x64_pd(x, 0xFF);
+	}
+	if (i < n) {
+		a[i] += _mm256_cvtsd_f64(c);
+		cumsum_scalar(a + i, n - i);
+	}
+}
+
+//
+// AVX-512
+//
+
+FPX_TARGET_AVX512
+static double sum_avx512(const double* a, int32_t n)
+{
+	__m512d s0 = _mm512_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+	int32_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		s0 = _mm512_add_pd(s0, _mm512_loadu_pd(a + i));
+		s1 = _mm512_add_pd(s1, _mm512_loadu_pd(a + i + 8));
+		s2 = _mm512_add_pd(s2, _mm512_loadu_pd(a + i + 16));
+		s3 = _mm512_add_pd(s3, _mm512_loadu_pd(a + i + 24));
+	}
+	for (; i < n; i += 8) {
+		__mmask8 k = n - i >= 8 ? 0xFF : (__mmask8)((1u << (n - i)) - 1);
+		s0 = _mm512_add_pd(s0, _mm512_maskz_loadu_pd(k, a + i));
+	}
+	s0 = _mm512_add_pd(_mm512_add_pd(s0, s1), _mm512_add_pd(s2, s3));
+
+	return _mm512_reduce_add_pd(s0);
+}
+
+FPX_TARGET_AVX512
+static double dot_avx512(const double* a, const double* b, int32_t n)
+{
+	__m512d s0 = _mm512_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+	int32_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		s0 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i), s0);
+		s1 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i + 8), _mm512_loadu_pd(b + i + 8), s1);
+		s2 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i + 16), _mm512_loadu_pd(b + i + 16), s2);
+		s3 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i + 24), _mm512_loadu_pd(b + i + 24), s3);
+	}
+	for (; i < n; i += 8) {
+		__mmask8 k = n - i >= 8 ? 0xFF : (__mmask8)((1u << (n - i)) - 1);
+		s0 = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(k, a + i), _mm512_maskz_loadu_pd(k, b + i), s0);
+	}
+	s0 = _mm512_add_pd(_mm512_add_pd(s0, s1), _mm512_add_pd(s2, s3));
+
+	return _mm512_reduce_add_pd(s0);
+}
+
+FPX_TARGET_AVX512
+static double min_avx512(const double* a, int32_t n)
+{
+	__m512d m = _mm512_set1_pd(INFINITY);
+	int32_t i = 0;
+	for (; i < n; i += 8) {
+		__mmask8 k = n - i >= 8 ? 0xFF : (__mmask8)((1u << (n - i)) - 1);
+		m = _mm512_mask_min_pd(m, k, m, _mm512_maskz_loadu_pd(k, a + i));
+	}
+
+	return _mm512_reduce_min_pd(m);
+}
+
+FPX_TARGET_AVX512
+static double max_avx512(const double* a, int32_t n)
+{
+	__m512d m = _mm512_set1_pd(-INFINITY);
+	int32_t i = 0;
+	for (; i < n; i += 8) {
+		__mmask8 k = n - i >= 8 ? 0xFF : (__mmask8)((1u << (n - i)) - 1);
+		m = _mm512_mask_max_pd(m, k, m, _mm512_maskz_loadu_pd(k, a + i));
+	}
+
+	return _mm512_reduce_max_pd(m);
+}
+
+FPX_TARGET_AVX512
+static void axpy_avx512(double a, const double* x, double* y, int32_t n)
+{
+	__m512d a_ = _mm512_set1_pd(a);
+	int32_t i = 0;
+	for (; i < n; i += 8) {
+		__mmask8 k = n - i >= 8 ? 0xFF : (__mmask8)((1u << (n - i)) - 1);
+		__m512d y_ = _mm512_fmadd_pd(a_, _mm512_maskz_loadu_pd(k, x + i), _mm512_maskz_loadu_pd(k, y + i));
+		_mm512_mask_storeu_pd(y + i, k, y_);
+	}
+}
+
+FPX_TARGET_AVX512
+static void scale_avx512(double a, double* x, int32_t n)
+{
+	__m512d a_ = _mm512_set1_pd(a);
+	int32_t i = 0;
+	for (; i < n; i += 8) {
+		__mmask8 k = n - i >= 8 ? 0xFF : (__mmask8)((1u << (n - i)) - 1);
+		_mm512_mask_storeu_pd(x + i, k, _mm512_mul_pd(a_, _mm512_maskz_loadu_pd(k, x + i)));
+	}
+}
+
+FPX_TARGET_AVX512
+static void op_avx512(int op, const double* x, double* y, int32_t n)
+{
+	int32_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m512d x_ = _mm512_loadu_pd(x + i);
+		__m512d y_ = _mm512_loadu_pd(y + i);
+		switch (op) {
+		case FPX_OP_ADD: y_ = _mm512_add_pd(y_, x_); break;
+		case FPX_OP_SUB: y_ = _mm512_sub_pd(y_, x_); break;
+		case FPX_OP_MUL: y_ = _mm512_mul_pd(y_, x_); break;
+		case FPX_OP_DIV: y_ = _mm512_div_pd(y_, x_); break;
+		}
+		_mm512_storeu_pd(y + i, y_);
+	}
+	op_scalar(op, x + i, y + i, n - i);
+}
+
+// 0 scalar, 1 AVX2 and FMA, 2 AVX-512F
+static int fpx_simd_supported(void)
+{
+#ifdef _MSC_VER
+	int r[4];
+	__cpuid(r, 0);
+	if (r[0] < 7) {
+		return 0;
+	}
+	__cpuid(r, 1);
+	int fma = (r[2] >> 12) & 1;
+	int osxsave = (r[2] >> 27) & 1;
+	int avx = (r[2] >> 28) & 1;
+	if (!osxsave || !avx) {
+		return 0;
+	}
+	unsigned long long xcr0 = _xgetbv(0);
+	if ((xcr0 & 0x6) != 0x6) {
+		return 0;
+	}
+	__cpuidex(r, 7, 0);
+	int avx2 = (r[1] >> 5) & 1;
+	int avx512f = (r[1] >> 16) & 1;
+	if (avx512f && (xcr0 & 0xE6) == 0xE6) {
+		return 2;
+	}
+
+	return avx2 && fma;
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) {
+		return 2;
+	}
+
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+#else
+
+static int fpx_simd_supported(void)
+{
+	return 0;
+}
+
+#endif // FPX_X86
+
+// Written on first use and read by functions running on every calc thread.
+#if defined(_MSC_VER) && !defined(__clang__)
+// relaxed atomic loads and stores, as in the MSVC STL
+static volatile int fpx_simd_level = -1;
+#define LEVEL_LOAD() __iso_volatile_load32(&fpx_simd_level)
+#define LEVEL_STORE(level) __iso_volatile_store32(&fpx_simd_level, (level))
+#else
+static _Atomic int fpx_simd_level = -1;
+#define LEVEL_LOAD() atomic_load_explicit(&fpx_simd_level, memory_order_relaxed)
+#define LEVEL_STORE(level) atomic_store_explicit(&fpx_simd_level, (level), memory_order_relaxed)
+#endif
+
+int fpx_simd(int level)
+{
+	int supported = fpx_simd_supported();
+
+	if (level >= 0) {
+		level = level < supported ? level : supported;
+		LEVEL_STORE(level);
+	}
+	else {
+		level = LEVEL_LOAD();
+		if (level < 0) {
+			// every thread computes the same value
+			level = supported;
+			LEVEL_STORE(level);
+		}
+	}
+
+	return level;
+}
+
+static int simd_level(void)
+{
+	int level = LEVEL_LOAD();
+
+	return level >= 0 ? level : fpx_simd(-1);
+}
+
+#if FPX_X86
+#define FPX_DISPATCH(f, ...) \
+	switch (simd_level()) { \
+	case 2: return f##_avx512(__VA_ARGS__); \
+	case 1: return f##_avx2(__VA_ARGS__); \
+	default: return f##_scalar(__VA_ARGS__); \
+	}
+#else
+#define FPX_DISPATCH(f, ...) return f##_scalar(__VA_ARGS__);
+#endif
+
+double fpx_sum(const double* a, int32_t n)
+{
+	FPX_DISPATCH(sum, a, n);
+}
+
+double fpx_dot(const double* a, const double* b, int32_t n)
+{
+	FPX_DISPATCH(dot, a, b, n);
+}
+
+double fpx_min(const double* a, int32_t n)
+{
+	FPX_DISPATCH(min, a, n);
+}
+
+double fpx_max(const double* a, int32_t n)
+{
+	FPX_DISPATCH(max, a, n);
+}
+
+void fpx_axpy(double a, const double* x, double* y, int32_t n)
+{
+	FPX_DISPATCH(axpy, a, x, y, n);
+}
+
+void fpx_scale(double a, double* x, int32_t n)
+{
+	FPX_DISPATCH(scale, a, x, n);
+}
+
+void fpx_add(const double* x, double* y, int32_t n)
+{
+	FPX_DISPATCH(op, FPX_OP_ADD, x, y, n);
+}
+
+void fpx_sub(const double* x, double* y, int32_t n)
+{
+	FPX_DISPATCH(op, FPX_OP_SUB, x, y, n);
+}
+
+void fpx_mul(const double* x, double* y, int32_t n)
+{
+	FPX_DISPATCH(op, FPX_OP_MUL, x, y, n);
+}
+
+void fpx_div(const double* x, double* y, int32_t n)
+{
+	FPX_DISPATCH(op, FPX_OP_DIV, x, y, n);
+}
+
+void fpx_cumsum(double* a, int32_t n)
+{
+#if FPX_X86
+	if (simd_level() > 0) {
+		cumsum_avx2(a, n);
+		return;
+	}
+#endif
+	cumsum_scalar(a, n);
+}
+
+void fpx_row_sums(int32_t r, int32_t c, const double* a, double* s)
+{
+	for (int32_t i = 0; i < r; ++i) {
+		s[i] = fpx_sum(a + (size_t)i * c, c);
+	}
+}
+
+// Accumulate whole rows to stay in row-major order.
+void fpx_column_sums(int32_t r, int32_t c, const double* a, double* s)
+{
+	for (int32_t j = 0; j < c; ++j) {
+		s[j] = 0;
+	}
+	for (int32_t i = 0; i < r; ++i) {
+		fpx_add(a + (size_t)i * c, s, c);
+	}
+}
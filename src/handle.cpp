@@ -0,0 +1,72 @@
+// handle.cpp - Statistics and garbage collection of handles.
+// Copyright (c) KALX, LLC. All rights reserved. No warranty made.
+#include <format>
+#include "xll.h"
+
+using namespace xll;
+
+AddIn xai_handle_sweep(
+	Macro(L"xll_handle_sweep", L"XLL.HANDLE.SWEEP")
+);
+int WINAPI xll_handle_sweep()
+{
+#pragma XLLEXPORT
+	try {
+		const auto s = handle_gc::sweep();
+		retired::reclaim();
+		const auto msg = std::format(L"XLL.HANDLE.SWEEP: freed {} of {} handles, {} bytes",
+			s.swept, s.handles, s.bytes);
+		Excel(xlcMessage, true, OPER(msg));
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+AddIn xai_handle_stats(
+	Function(XLL_LPOPER, L"xll_handle_stats", L"HANDLE.STATS")
+	.Volatile()
+	.ThreadSafe()
+	.Category(L"XLL")
+	.FunctionHelp(L"Return counts, bytes, rates, and lookup latency of each handle type.")
+);
+LPOPER WINAPI xll_handle_stats()
+{
+#pragma XLLEXPORT
+	XLL_RESULT(o);
+
+	try {
+		o = handle_stats::table();
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		o = ErrNA;
+	}
+
+	return &o;
+}
+
+AddIn xai_handle_typename(
+	Function(XLL_LPOPER, L"xll_handle_typename", L"HANDLE.TYPENAME")
+	.Arguments({
+		Arg(XLL_HANDLEX, L"handle", L"is a handle."),
+		})
+	.ThreadSafe()
+	.Category(L"XLL")
+	.FunctionHelp(L"Return the type name of the object a handle points to.")
+);
+LPOPER WINAPI xll_handle_typename(HANDLEX h)
+{
+#pragma XLLEXPORT
+	XLL_RESULT(o);
+
+	const char* name = handle_typename.find(h);
+	o = name ? OPER(name) : ErrNA;
+
+	return &o;
+}
@@ -0,0 +1,466 @@
+// host.cpp - In-process stand-in for Excel.
+// Copyright (c) KALX, LLC. All rights reserved. No warranty made.
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cwchar>
+#include <cwctype>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include "host.h"
+
+extern "C" void PASCAL SetExcel12EntryPt(int (PASCAL* pexcel12New)(int, int, LPXLOPER12*, LPXLOPER12));
+
+using namespace xll;
+
+namespace {
+
+	// Excel names are case insensitive.
+	std::wstring key(std::wstring_view name)
+	{
+		if (name.starts_with(L'=')) {
+			name.remove_prefix(1);
+		}
+		std::wstring k(name);
+		for (auto& c : k) {
+			c = static_cast<wchar_t>(std::towupper(c));
+		}
+
+		return k;
+	}
+
+	// Excel calls can come from any calc thread.
+	// handlers_mutex guards handlers, mutex guards the workbook.
+	struct state {
+		std::shared_mutex handlers_mutex;
+		std::map<int, host::handler> handlers;
+		std::recursive_mutex mutex;
+		std::map<std::pair<RW, COL>, OPER> cells;
+		std::map<std::wstring, OPER> names;
+		std::map<std::wstring, double> regids;
+		OPER selection;
+		bool echo = true; // screen updating
+		double calculation = 1; // automatic
+		double regid = 0;
+		std::atomic<size_t> calls = 0;
+
+		state();
+	};
+
+	state& host_state()
+	{
+		static state s;
+
+		return s;
+	}
+
+	// Free memory allocated by host::result.
+	// Callers may clear xlbitXLFree before calling xlFree.
+	void free_result(XLOPER12& x)
+	{
+		if (isAlloc(x)) {
+			if (type(x) == xltypeStr) {
+				delete[] x.val.str;
+			}
+			else if (type(x) == xltypeMulti) {
+				for (int i = 0; i < size(x); ++i) {
+					if (type(x.val.array.lparray[i]) == xltypeStr) {
+						delete[] x.val.array.lparray[i].val.str;
+					}
+				}
+				delete[] x.val.array.lparray;
+			}
+			x.xltype = xltypeNil;
+		}
+	}
+
+	// Single area of a reference or an empty REF.
+	REF area(const XLOPER12& x)
+	{
+		if (type(x) == xltypeSRef) {
+			return x.val.sref.ref;
+		}
+		if (type(x) == xltypeRef && x.val.mref.lpmref && x.val.mref.lpmref->count == 1) {
+			return x.val.mref.lpmref->reftbl[0];
+		}
+
+		return REF();
+	}
+
+	int xl_free(int count, LPXLOPER12* opers, LPXLOPER12)
+	{
+		for (int i = 0; i < count; ++i) {
+			free_result(*opers[i]);
+		}
+
+		return xlretSuccess;
+	}
+
+	// Values of a single area reference. Anything else is returned as is.
+	int xl_coerce(int count, LPXLOPER12* opers, LPXLOPER12 res)
+	{
+		if (count < 1) {
+			return xlretInvCount;
+		}
+		const XLOPER12& x = *opers[0];
+		if (type(x) == xltypeSRef || type(x) == xltypeRef) {
+			const REF r = area(x);
+			if (!r) {
+				return xlretFailed;
+			}
+			std::lock_guard lock(host_state().mutex);
+			if (rows(r) == 1 && columns(r) == 1) {
+				host::result(res, host::cell(r.rwFirst, r.colFirst));
+			}
+			else {
+				OPER o(rows(r), columns(r));
+				for (int i = 0; i < rows(r); ++i) {
+					for (int j = 0; j < columns(r); ++j) {
+						o(i, j) = host::cell(r.rwFirst + i, r.colFirst + j);
+					}
+				}
+				host::result(res, o);
+			}
+		}
+		else {
+			host::result(res, x);
+		}
+
+		return xlretSuccess;
+	}
+
+	// The workbook has one sheet.
+	int xl_sheet_nm(int count, LPXLOPER12* opers, LPXLOPER12 res)
+	{
+		if (count < 1 || !area(*opers[0])) {
+			return xlretFailed;
+		}
+		host::result(res, OPER(L"[host.xll]Sheet1"));
+
+		return xlretSuccess;
+	}
+
+	int xl_get_name(int, LPXLOPER12*, LPXLOPER12 res)
+	{
+		host::result(res, OPER(L"host.xll"));
+
+		return xlretSuccess;
+	}
+
+	int xlf_caller(int, LPXLOPER12*, LPXLOPER12 res)
+	{
+		host::result(res, host::caller());
+
+		return xlretSuccess;
+	}
+
+	int xlf_evaluate(int count, LPXLOPER12* opers, LPXLOPER12 res)
+	{
+		if (count < 1) {
+			return xlretInvCount;
+		}
+		const XLOPER12& x = *opers[0];
+		if (type(x) != xltypeStr) {
+			host::result(res, x);
+
+			return xlretSuccess;
+		}
+
+		auto& s = host_state();
+		std::lock_guard lock(s.mutex);
+		const auto k = key(view(x));
+		if (auto n = s.names.find(k); n != s.names.end()) {
+			host::result(res, n->second);
+		}
+		else if (auto r = s.regids.find(k); r != s.regids.end()) {
+			host::result(res, OPER(r->second));
+		}
+		else {
+			wchar_t* end = nullptr;
+			const double num = std::wcstod(k.c_str(), &end);
+			host::result(res, !k.empty() && end && *end == 0 ? OPER(num) : ErrName);
+		}
+
+		return xlretSuccess;
+	}
+
+	// xlSet(ref, value) of a scalar or an array the size of ref
+	int xl_set(int count, LPXLOPER12* opers, LPXLOPER12)
+	{
+		const REF r = count > 0 ? area(*opers[0]) : REF();
+		if (!r) {
+			return xlretFailed;
+		}
+		const XLOPER12& x = count > 1 ? *opers[1] : Nil;
+		std::lock_guard lock(host_state().mutex);
+		for (int i = 0; i < rows(r); ++i) {
+			for (int j = 0; j < columns(r); ++j) {
+				host::cell(r.rwFirst + i, r.colFirst + j) = type(x) == xltypeMulti ? index(x, i, j) : x;
+			}
+		}
+
+		return xlretSuccess;
+	}
+
+	int xlc_select(int count, LPXLOPER12* opers, LPXLOPER12 res)
+	{
+		if (count < 1) {
+			return xlretInvCount;
+		}
+		auto& s = host_state();
+		std::lock_guard lock(s.mutex);
+		s.selection = *opers[0];
+		host::result(res, True);
+
+		return xlretSuccess;
+	}
+
+	// xlcEcho(logical) or toggle if missing
+	int xlc_echo(int count, LPXLOPER12* opers, LPXLOPER12 res)
+	{
+		auto& s = host_state();
+		std::lock_guard lock(s.mutex);
+		s.echo = count > 0 && type(*opers[0]) != xltypeMissing ? isTrue(*opers[0]) : !s.echo;
+		host::result(res, True);
+
+		return xlretSuccess;
+	}
+
+	// xlcOptionsCalculation(type_num, ...)
+	int xlc_options_calculation(int count, LPXLOPER12* opers, LPXLOPER12 res)
+	{
+		if (count < 1 || std::isnan(asNum(*opers[0]))) {
+			return xlretFailed;
+		}
+		auto& s = host_state();
+		std::lock_guard lock(s.mutex);
+		s.calculation = asNum(*opers[0]);
+		host::result(res, True);
+
+		return xlretSuccess;
+	}
+
+	// Only GET.WORKSPACE(40), screen updating.
+	int xlf_get_workspace(int count, LPXLOPER12* opers, LPXLOPER12 res)
+	{
+		if (count < 1 || asNum(*opers[0]) != 40) {
+			return xlretFailed;
+		}
+		auto& s = host_state();
+		std::lock_guard lock(s.mutex);
+		host::result(res, OPER(s.echo));
+
+		return xlretSuccess;
+	}
+
+	// Only GET.DOCUMENT(9-12), first and last used row and column, and
+	// GET.DOCUMENT(14), calculation mode.
+	int xlf_get_document(int count, LPXLOPER12* opers, LPXLOPER12 res)
+	{
+		const double type_num = count < 1 ? 0 : asNum(*opers[0]);
+		if (!(type_num >= 9 && type_num <= 12) && type_num != 14) {
+			return xlretFailed;
+		}
+		auto& s = host_state();
+		std::lock_guard lock(s.mutex);
+		if (type_num == 14) {
+			host::result(res, OPER(s.calculation));
+
+			return xlretSuccess;
+		}
+
+		// 1-based, 0 if the sheet is empty
+		const bool first = type_num == 9 || type_num == 11;
+		double bound = 0;
+		for (const auto& [rc, x] : s.cells) {
+			if (type(x) != xltypeNil) {
+				const double i = 1. + (type_num <= 10 ? rc.first : rc.second);
+				bound = bound == 0 ? i : first ? (std::min)(bound, i) : (std::max)(bound, i);
+			}
+		}
+		host::result(res, OPER(bound));
+
+		return xlretSuccess;
+	}
+
+	// xlfRegister(module, procedure, type, function, ...)
+	int xlf_register(int count, LPXLOPER12* opers, LPXLOPER12 res)
+	{
+		if (count < 4) {
+			return xlretInvCount;
+		}
+
+		auto& s = host_state();
+		std::lock_guard lock(s.mutex);
+		const double regid = ++s.regid;
+		for (int i : {1, 3}) {
+			if (type(*opers[i]) == xltypeStr) {
+				s.regids[key(view(*opers[i]))] = regid;
+			}
+		}
+		host::result(res, OPER(regid));
+
+		return xlretSuccess;
+	}
+
+	int xlf_unregister(int count, LPXLOPER12* opers, LPXLOPER12 res)
+	{
+		if (count < 1) {
+			return xlretInvCount;
+		}
+
+		auto& s = host_state();
+		std::lock_guard lock(s.mutex);
+		bool found = false;
+		if (type(*opers[0]) == xltypeNum) {
+			std::erase_if(s.regids, [regid = opers[0]->val.num, &found](const auto& r) {
+				if (r.second == regid) {
+					found = true;
+
+					return true;
+				}
+
+				return false;
+			});
+		}
+		host::result(res, OPER(found));
+
+		return xlretSuccess;
+	}
+
+	// xlfSetName(name, value) or xlcDefineName(name, refers_to, ...)
+	int xlf_set_name(int count, LPXLOPER12* opers, LPXLOPER12 res)
+	{
+		if (count < 1 || type(*opers[0]) != xltypeStr) {
+			return xlretFailed;
+		}
+
+		auto& s = host_state();
+		std::lock_guard lock(s.mutex);
+		const auto k = key(view(*opers[0]));
+		if (count == 1 || type(*opers[1]) == xltypeMissing) {
+			s.names.erase(k);
+		}
+		else {
+			s.names[k] = *opers[1];
+		}
+		host::result(res, True);
+
+		return xlretSuccess;
+	}
+
+	state::state()
+	{
+		handlers[xlFree] = xl_free;
+		handlers[xlCoerce] = xl_coerce;
+		handlers[xlSheetNm] = xl_sheet_nm;
+		handlers[xlGetName] = xl_get_name;
+		handlers[xlfCaller] = xlf_caller;
+		handlers[xlfEvaluate] = xlf_evaluate;
+		handlers[xlfRegister] = xlf_register;
+		handlers[xlfUnregister] = xlf_unregister;
+		handlers[xlfSetName] = xlf_set_name;
+		handlers[xlcDefineName] = xlf_set_name;
+		handlers[xlSet] = xl_set;
+		handlers[xlcSelect] = xlc_select;
+		handlers[xlcEcho] = xlc_echo;
+		handlers[xlcOptionsCalculation] = xlc_options_calculation;
+		handlers[xlfGetWorkspace] = xlf_get_workspace;
+		handlers[xlfGetDocument] = xlf_get_document;
+	}
+
+} // namespace
+
+namespace xll::host {
+
+	handler on(int xlfn, handler f)
+	{
+		auto& s = host_state();
+		std::unique_lock lock(s.handlers_mutex);
+
+		auto& h = s.handlers[xlfn];
+		std::swap(h, f);
+
+		return f;
+	}
+
+	int PASCAL callback(int xlfn, int count, LPXLOPER12* opers, LPXLOPER12 res)
+	{
+		auto& s = host_state();
+
+		++s.calls;
+		handler f;
+		{
+			std::shared_lock lock(s.handlers_mutex);
+			const auto h = s.handlers.find(xlfn & ~(xlIntl | xlPrompt));
+			if (h == s.handlers.end() || !h->second) {
+				return xlretFailed;
+			}
+			f = h->second;
+		}
+		if (res) {
+			res->xltype = xltypeNil;
+		}
+
+		return f(count, opers, res);
+	}
+
+	void install()
+	{
+		SetExcel12EntryPt(callback);
+	}
+
+	OPER& caller()
+	{
+		thread_local OPER caller(REF(0, 0));
+
+		return caller;
+	}
+
+	OPER& cell(RW row, COL column)
+	{
+		auto& s = host_state();
+		std::lock_guard lock(s.mutex);
+
+		return s.cells[{row, column}];
+	}
+
+	void result(LPXLOPER12 res, const XLOPER12& x)
+	{
+		if (!res) {
+			return;
+		}
+
+		*res = x;
+		res->xltype = type(x);
+		if (type(x) == xltypeStr) {
+			const auto n = static_cast<size_t>(x.val.str[0]) + 1;
+			res->val.str = new XCHAR[n];
+			std::copy_n(x.val.str, n, res->val.str);
+			res->xltype |= xlbitXLFree;
+		}
+		else if (type(x) == xltypeMulti) {
+			const auto n = static_cast<size_t>(size(x));
+			res->val.array.lparray = new XLOPER12[n];
+			for (size_t i = 0; i < n; ++i) {
+				XLOPER12& xi = res->val.array.lparray[i];
+				xi = x.val.array.lparray[i];
+				xi.xltype = type(xi);
+				if (type(xi) == xltypeStr) {
+					const auto m = static_cast<size_t>(xi.val.str[0]) + 1;
+					xi.val.str = new XCHAR[m];
+					std::copy_n(x.val.array.lparray[i].val.str, m, xi.val.str);
+				}
+			}
+			res->xltype |= xlbitXLFree;
+		}
+	}
+
+	size_t calls()
+	{
+		return host_state().calls;
+	}
+
+} // namespace xll::host
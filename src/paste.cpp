@@ -67,7 +67,7 @@ OPER Formula(const Args* pargs)
 OPER Move(const XLOPER12& o, int r, int c, int w = 1, int h = 1)
 {
 	OPER sel = Excel(xlfOffset, o, r, c, w, h);
-	OPER s = Excel(xlcSelect, sel);
+	command(xlcSelect, sel);
 	return sel;
 }
 
@@ -83,17 +83,18 @@ OPER Set(const OPER& ref, const OPER& val)
 	OPER res = ref;
 
 	if (isFormula(val)) {
+		command_batch::sync(); // might refer to names just defined
 		OPER eval = Excel(xlfEvaluate, val);
 		if (isMulti(eval)) {
 			res = Reshape(ref, eval);
-			Excel(xlSet, res, eval);
+			command(xlSet, res, eval);
 		}
 		else {
-			Excel(xlcFormula, val, res);
+			command(xlcFormula, val, res);
 		}
 	}
 	else {
-		Excel(xlSet, ref, val);
+		command(xlSet, ref, val);
 	}
 
 	return res;
@@ -109,6 +110,7 @@ int WINAPI xll_pasteb()
 	int result = TRUE;
 
 	try {
+		Suspend suspend;
 		OPER active = Excel(xlfActiveCell);
 		OPER cell = Excel(xlCoerce, active);
 		const Args* pargs = AddIn::find(cell);
@@ -147,6 +149,8 @@ int WINAPI xll_pastec()
 	int result = TRUE;
 
 	try {
+		Suspend suspend;
+		command_batch batch;
 		OPER caller = Excel(xlfActiveCell);
 		OPER text = Excel(xlCoerce, caller);
 		const Args* pargs = AddIn::find(text);
@@ -176,12 +180,13 @@ int WINAPI xll_pastec()
 		}
 		formula &= OPER(L")");
 
-		Excel(xlcFormula, formula, output);
-		Excel(xlcSelect, output);
+		command(xlcFormula, formula, output);
+		command(xlcSelect, output);
 		if (isHandle(text)) {
-			Excel(xlcApplyStyle, L"Handle");
+			command(xlcApplyStyle, L"Handle");
 		}
 //		Excel(xlcApplyStyle, isHandle(text) ? L"Handle" : L"Output");
+		batch.flush();
 	}
 	catch (const std::exception& ex) {
 		result = FALSE;
@@ -206,13 +211,15 @@ int WINAPI xll_pasted()
 	int result = TRUE;
 
 	try {
+		Suspend suspend;
+		command_batch batch;
 		OPER caller = Excel(xlfActiveCell);
 		OPER text = Excel(xlCoerce, caller);
 		const Args* pargs = AddIn::find(text);
 		ensure(pargs || !"xll_pasted: add-in not found");
 		text = pargs->functionText;
 
-		Excel(xlSet, caller, text);
+		command(xlSet, caller, text);
 		AlignHorizontalRight();
 		FormatFont().Italic();
 
@@ -234,15 +241,15 @@ int WINAPI xll_pasted()
 
 			active = Move(active, 0, 1);
 			if (isNil(pargs->argumentInit[i])) {
-				Excel(xlcDefineName, name, active, Missing, Missing, Missing, Missing, true);
-				Excel(xlcApplyStyle, L"Input");
+				command(xlcDefineName, name, active, Missing, Missing, Missing, Missing, true);
+				command(xlcApplyStyle, L"Input");
 				active = Move(active, 1, -1);
 			}
 			else {
 				const auto ref = Set(active, pargs->argumentInit[i]);
-				Excel(xlcDefineName, name, ref, Missing, Missing, Missing, Missing, true);
-				Excel(xlcSelect, ref);
-				Excel(xlcApplyStyle, L"Input");
+				command(xlcDefineName, name, ref, Missing, Missing, Missing, Missing, true);
+				command(xlcSelect, ref);
+				command(xlcApplyStyle, L"Input");
 				active = Move(active, rows(ref), -1);
 			}
 
@@ -250,9 +257,10 @@ int WINAPI xll_pasted()
 		}
 		formula &= OPER(L")");
 
-		Excel(xlcFormula, formula, output);
-		Excel(xlcSelect, output);
-		Excel(xlcApplyStyle, isHandle(text) ? L"Handle" : L"Output");
+		command(xlcFormula, formula, output);
+		command(xlcSelect, output);
+		command(xlcApplyStyle, isHandle(text) ? L"Handle" : L"Output");
+		batch.flush();
 	}
 	catch (const std::exception& ex) {
 		result = FALSE;
@@ -291,6 +299,7 @@ int WINAPI xll_list()
 {
 #pragma XLLEXPORT
 	try {
+		Suspend suspend;
 		OPER ret;
 		auto ac = Excel(xlfActiveCell);
 		auto sel = Excel(xlfSelection);
@@ -158,7 +158,8 @@ xlAutoRegister12(const LPXLOPER12 pxName)
 	static XLOPER12 o;
 
 	try {
-		auto addin = AddIn::find(OPER(*pxName));
+		// Excel passes the procedure name in lower case.
+		auto addin = registry::instance().procedure(*pxName);
 		o = addin ? XlfRegister(addin) : ErrValue;
 	}
 	catch (const std::exception& ex) {
@@ -182,7 +183,7 @@ extern "C" const XLOPER12* WINAPI
 xlAddInManagerInfo12(LPXLOPER12 pxAction)
 {
 	XLL_TRACE;
-	static OPER xInfo;
+	XLL_RESULT(xInfo);
 
 	// Coerce to int and check if action is 1.
 	if (Excel(xlCoerce, *pxAction, OPER(xltypeInt)) == 1) {
@@ -0,0 +1,916 @@
+// bench.cpp - micro-benchmarks of OPER, FPX, and handle hot paths.
+// Copyright (c) KALX, LLC. All rights reserved. No warranty made.
+// Runs headless against the Excel stand-in in host.h. Output is compatible
+// with Google Benchmark so tools like compare.py can diff two runs.
+//   xll_bench [--benchmark_filter=regex] [--benchmark_min_time=seconds]
+//             [--benchmark_format=console|json|csv] [--benchmark_out=file]
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <functional>
+#include <numeric>
+#include <optional>
+#include <regex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "host.h"
+#include "addin.h"
+#include "fp.h"
+#include "handle.h"
+#include "macrofun.h"
+
+using namespace xll;
+
+namespace bench {
+
+	using clock = std::chrono::steady_clock;
+
+	// Prevent the compiler from optimizing away x.
+	template<class T>
+	inline void keep(const T& x)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		asm volatile("" : : "m"(x) : "memory");
+#else
+		static const void* volatile sink;
+		sink = &x;
+#endif
+	}
+
+	// Timing of one run. Use for ([[maybe_unused]] auto _ : state) { ... } in the benchmark.
+	class state {
+		int64_t arg;
+		int64_t n;
+		int64_t items_ = 0;
+		clock::time_point start;
+		std::clock_t cpu_start = 0;
+	public:
+		clock::duration real{};
+		std::clock_t cpu = 0;
+
+		state(int64_t arg, int64_t n)
+			: arg(arg), n(n)
+		{ }
+
+		// Size argument of the benchmark.
+		int64_t range() const
+		{
+			return arg;
+		}
+		int64_t iterations() const
+		{
+			return n;
+		}
+		// Items processed per iteration for items_per_second.
+		void items(int64_t m)
+		{
+			items_ = m;
+		}
+		int64_t items() const
+		{
+			return items_;
+		}
+
+		// Exclude setup inside the loop from the timing.
+		void pause()
+		{
+			real += clock::now() - start;
+			cpu += std::clock() - cpu_start;
+		}
+		void resume()
+		{
+			cpu_start = std::clock();
+			start = clock::now();
+		}
+
+		struct sentinel { };
+		struct iterator {
+			state* s;
+			int64_t i;
+
+			int operator*() const
+			{
+				return 0;
+			}
+			iterator& operator++()
+			{
+				--i;
+
+				return *this;
+			}
+			bool operator!=(sentinel) const
+			{
+				if (i > 0) {
+					return true;
+				}
+				s->pause();
+
+				return false;
+			}
+		};
+		iterator begin()
+		{
+			resume();
+
+			return iterator{ this, n };
+		}
+		sentinel end() const
+		{
+			return sentinel{};
+		}
+	};
+
+	struct benchmark {
+		std::string name;
+		std::function<void(state&)> f;
+		std::vector<int64_t> args;
+	};
+	inline std::vector<benchmark>& registry()
+	{
+		static std::vector<benchmark> bs;
+
+		return bs;
+	}
+	struct add {
+		add(const char* name, void (*f)(state&), std::initializer_list<int64_t> args)
+		{
+			registry().push_back(benchmark{ name, f, args });
+		}
+	};
+
+	struct result {
+		std::string name;
+		int64_t iterations;
+		double real_time; // ns per iteration
+		double cpu_time;
+		double items_per_second;
+	};
+
+	// Double the iterations until the run takes at least min_time seconds.
+	inline result run(const benchmark& b, int64_t arg, double min_time)
+	{
+		int64_t n = 1;
+		for (;;) {
+			state s(arg, n);
+			b.f(s);
+			const double t = std::chrono::duration<double>(s.real).count();
+			if (t >= min_time || n >= 1'000'000'000) {
+				const double cpu = double(s.cpu) / CLOCKS_PER_SEC;
+				return result{
+					b.name + "/" + std::to_string(arg),
+					n,
+					1e9 * t / n,
+					1e9 * cpu / n,
+					t > 0 ? double(s.items()) * n / t : 0,
+				};
+			}
+			// aim for 1.4 times min_time but grow at most 10 times
+			const double m = t > 0 ? 1.4 * min_time / t : 10;
+			n = static_cast<int64_t>(n * (std::min)((std::max)(m, 2.), 10.));
+		}
+	}
+
+	inline void console(FILE* out, const std::vector<result>& rs)
+	{
+		fprintf(out, "%-36s %15s %15s %12s %14s\n", "Benchmark", "Time", "CPU", "Iterations", "items/s");
+		for (const auto& r : rs) {
+			fprintf(out, "%-36s %12.0f ns %12.0f ns %12lld %14.4g\n",
+				r.name.c_str(), r.real_time, r.cpu_time, (long long)r.iterations, r.items_per_second);
+		}
+	}
+
+	inline void json(FILE* out, const std::vector<result>& rs)
+	{
+		char date[32];
+		const std::time_t now = std::time(nullptr);
+		std::strftime(date, sizeof date, "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+		fprintf(out, "{\n  \"context\": {\n");
+		fprintf(out, "    \"date\": \"%s\",\n", date);
+		fprintf(out, "    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+		fprintf(out, "    \"fpx_simd\": %d,\n", fpx_simd(-1));
+#ifdef NDEBUG
+		fprintf(out, "    \"library_build_type\": \"release\"\n");
+#else
+		fprintf(out, "    \"library_build_type\": \"debug\"\n");
+#endif
+		fprintf(out, "  },\n  \"benchmarks\": [");
+		for (size_t i = 0; i < rs.size(); ++i) {
+			const auto& r = rs[i];
+			fprintf(out, "%s\n    {\n", i ? "," : "");
+			fprintf(out, "      \"name\": \"%s\",\n", r.name.c_str());
+			fprintf(out, "      \"run_name\": \"%s\",\n", r.name.c_str());
+			fprintf(out, "      \"run_type\": \"iteration\",\n");
+			fprintf(out, "      \"iterations\": %lld,\n", (long long)r.iterations);
+			fprintf(out, "      \"real_time\": %.17g,\n", r.real_time);
+			fprintf(out, "      \"cpu_time\": %.17g,\n", r.cpu_time);
+			fprintf(out, "      \"time_unit\": \"ns\",\n");
+			fprintf(out, "      \"items_per_second\": %.17g\n", r.items_per_second);
+			fprintf(out, "    }");
+		}
+		fprintf(out, "\n  ]\n}\n");
+	}
+
+	inline void csv(FILE* out, const std::vector<result>& rs)
+	{
+		fprintf(out, "name,iterations,real_time,cpu_time,time_unit,items_per_second\n");
+		for (const auto& r : rs) {
+			fprintf(out, "\"%s\",%lld,%.17g,%.17g,ns,%.17g\n",
+				r.name.c_str(), (long long)r.iterations, r.real_time, r.cpu_time, r.items_per_second);
+		}
+	}
+
+} // namespace bench
+
+#define BENCHMARK(f, ...) static bench::add f##_add(#f, f, { __VA_ARGS__ })
+
+namespace {
+
+	OPER nums(int n)
+	{
+		OPER o(n, 1);
+		for (int i = 0; i < n; ++i) {
+			o[i] = OPER(double(i));
+		}
+
+		return o;
+	}
+
+	OPER strs(int n)
+	{
+		OPER o(n, 1);
+		for (int i = 0; i < n; ++i) {
+			o[i] = OPER(L"string");
+		}
+
+		return o;
+	}
+
+	// num, str, bool, err, nil
+	OPER mixed(int n)
+	{
+		OPER o(n, 1);
+		for (int i = 0; i < n; ++i) {
+			switch (i % 5) {
+			case 0: o[i] = OPER(double(i)); break;
+			case 1: o[i] = OPER(L"string"); break;
+			case 2: o[i] = OPER(true); break;
+			case 3: o[i] = ErrNA; break;
+			}
+		}
+
+		return o;
+	}
+
+	// n x 1 multi of 2 x 2 multis
+	OPER nested(int n)
+	{
+		OPER o(n, 1);
+		for (int i = 0; i < n; ++i) {
+			o[i] = OPER({ OPER(double(i)), OPER(L"a") });
+			o[i].resize(2, 2);
+		}
+
+		return o;
+	}
+
+	FPX iota(int32_t r, int32_t c)
+	{
+		FPX a(r, c);
+		std::iota(a.array(), a.array() + a.size(), 0.);
+
+		return a;
+	}
+
+	struct base {
+		int64_t x;
+		base(int64_t x = 0)
+			: x(x)
+		{ }
+		virtual ~base() { }
+	};
+
+} // namespace
+
+// String of n characters.
+void oper_str(bench::state& state)
+{
+	const std::wstring s(state.range(), L'x');
+	for ([[maybe_unused]] auto _ : state) {
+		OPER o(s.c_str());
+		bench::keep(o);
+	}
+}
+BENCHMARK(oper_str, 1, 8, 64, 1024);
+
+// Construct and destroy an n x 1 multi.
+void oper_multi(bench::state& state)
+{
+	const int n = static_cast<int>(state.range());
+	for ([[maybe_unused]] auto _ : state) {
+		OPER o(n, 1);
+		bench::keep(o);
+	}
+	state.items(n);
+}
+BENCHMARK(oper_multi, 16, 1024, 1 << 16);
+
+void oper_copy_num(bench::state& state)
+{
+	const OPER o = nums(static_cast<int>(state.range()));
+	for ([[maybe_unused]] auto _ : state) {
+		OPER o_(o);
+		bench::keep(o_);
+	}
+	state.items(state.range());
+}
+BENCHMARK(oper_copy_num, 16, 1024, 1 << 16);
+
+void oper_copy_str(bench::state& state)
+{
+	const OPER o = strs(static_cast<int>(state.range()));
+	for ([[maybe_unused]] auto _ : state) {
+		OPER o_(o);
+		bench::keep(o_);
+	}
+	state.items(state.range());
+}
+BENCHMARK(oper_copy_str, 16, 1024, 1 << 16);
+
+void oper_copy_mixed(bench::state& state)
+{
+	const OPER o = mixed(static_cast<int>(state.range()));
+	for ([[maybe_unused]] auto _ : state) {
+		OPER o_(o);
+		bench::keep(o_);
+	}
+	state.items(state.range());
+}
+BENCHMARK(oper_copy_mixed, 16, 1024, 1 << 16);
+
+// Destructor of a multi of strings.
+void oper_destroy_str(bench::state& state)
+{
+	const OPER o = strs(static_cast<int>(state.range()));
+	for ([[maybe_unused]] auto _ : state) {
+		state.pause();
+		OPER* po = new OPER(o);
+		state.resume();
+		delete po;
+	}
+	state.items(state.range());
+}
+BENCHMARK(oper_destroy_str, 1024, 1 << 20);
+
+// Destructor of a multi of numbers.
+void oper_destroy_num(bench::state& state)
+{
+	const OPER o = nums(static_cast<int>(state.range()));
+	for ([[maybe_unused]] auto _ : state) {
+		state.pause();
+		OPER* po = new OPER(o);
+		state.resume();
+		delete po;
+	}
+	state.items(state.range());
+}
+BENCHMARK(oper_destroy_num, 1024, 1 << 20);
+
+// Destructor of a compressed multi of numbers owning one nested handle in its last element.
+void oper_destroy_nested(bench::state& state)
+{
+	const int n = static_cast<int>(state.range());
+	OPER o = nums(n);
+	o[n - 1] = nested(1)[0];
+	for ([[maybe_unused]] auto _ : state) {
+		state.pause();
+		OPER* po = new OPER(compress(o));
+		state.resume();
+		delete po;
+	}
+	state.items(state.range());
+}
+BENCHMARK(oper_destroy_nested, 1024, 1 << 20);
+
+// Build and free an n x 1 multi of strings to return to Excel.
+void oper_result_heap(bench::state& state)
+{
+	const std::wstring s(16, L'x');
+	for ([[maybe_unused]] auto _ : state) {
+		OPER* po = new OPER(static_cast<int>(state.range()), 1);
+		for (OPER& oi : *po) {
+			oi = s;
+		}
+		bench::keep(*po);
+		delete po; // xlAutoFree12
+	}
+	state.items(state.range());
+}
+BENCHMARK(oper_result_heap, 1024, 1 << 16);
+
+void oper_result_arena(bench::state& state)
+{
+	const std::wstring s(16, L'x');
+	for ([[maybe_unused]] auto _ : state) {
+		OPER* po = arena_oper(static_cast<int>(state.range()), 1);
+		for (OPER& oi : *po) {
+			oi = s;
+		}
+		bench::keep(*po);
+		arena::release(); // calculation ended
+	}
+	state.items(state.range());
+}
+BENCHMARK(oper_result_arena, 1024, 1 << 16);
+
+// Concatenate n short strings.
+void oper_concat(bench::state& state)
+{
+	const OPER abc(L"abc");
+	for ([[maybe_unused]] auto _ : state) {
+		OPER o(L"");
+		for (int64_t i = 0; i < state.range(); ++i) {
+			o &= abc;
+		}
+		bench::keep(o);
+	}
+	state.items(state.range());
+}
+BENCHMARK(oper_concat, 1, 16, 256);
+
+// Stack n two column rows.
+void oper_vstack(bench::state& state)
+{
+	const OPER row({ OPER(1.), OPER(L"a") });
+	for ([[maybe_unused]] auto _ : state) {
+		OPER o;
+		for (int64_t i = 0; i < state.range(); ++i) {
+			o.vstack(row);
+		}
+		bench::keep(o);
+	}
+	state.items(state.range());
+}
+BENCHMARK(oper_vstack, 16, 1024, 16384);
+
+void oper_append(bench::state& state)
+{
+	const OPER x(1.);
+	for ([[maybe_unused]] auto _ : state) {
+		OPER o;
+		for (int64_t i = 0; i < state.range(); ++i) {
+			o.append(x);
+		}
+		bench::keep(o);
+	}
+	state.items(state.range());
+}
+BENCHMARK(oper_append, 16, 1024, 1 << 16);
+
+void oper_compress(bench::state& state)
+{
+	const OPER o = nested(static_cast<int>(state.range()));
+	for ([[maybe_unused]] auto _ : state) {
+		OPER o_ = compress(o);
+		bench::keep(o_);
+	}
+	state.items(state.range());
+}
+BENCHMARK(oper_compress, 16, 1024);
+
+void oper_expand(bench::state& state)
+{
+	const OPER o = compress(nested(static_cast<int>(state.range())));
+	for ([[maybe_unused]] auto _ : state) {
+		OPER o_ = expand(o);
+		bench::keep(o_);
+	}
+	state.items(state.range());
+}
+BENCHMARK(oper_expand, 16, 1024);
+
+void fpx_append(bench::state& state)
+{
+	for ([[maybe_unused]] auto _ : state) {
+		FPX a;
+		for (int64_t i = 0; i < state.range(); ++i) {
+			a.append(double(i));
+		}
+		bench::keep(a);
+	}
+	state.items(state.range());
+}
+BENCHMARK(fpx_append, 16, 1024, 1 << 20);
+
+// Stack n rows of 8 columns.
+void fpx_vstack(bench::state& state)
+{
+	const FPX row = iota(1, 8);
+	for ([[maybe_unused]] auto _ : state) {
+		FPX a;
+		for (int64_t i = 0; i < state.range(); ++i) {
+			a.vstack(row);
+		}
+		bench::keep(a);
+	}
+	state.items(state.range());
+}
+BENCHMARK(fpx_vstack, 16, 1024, 1 << 16);
+
+// In-place transpose of n x n.
+void fpx_transpose_square(bench::state& state)
+{
+	const auto n = static_cast<int32_t>(state.range());
+	FPX a = iota(n, n);
+	for ([[maybe_unused]] auto _ : state) {
+		a.transpose();
+		bench::keep(a);
+	}
+	state.items(a.size());
+}
+BENCHMARK(fpx_transpose_square, 10, 100, 1000, 4000);
+
+// In-place transpose of n x 2n.
+void fpx_transpose_rect(bench::state& state)
+{
+	const auto n = static_cast<int32_t>(state.range());
+	FPX a = iota(n, 2 * n);
+	for ([[maybe_unused]] auto _ : state) {
+		a.transpose();
+		bench::keep(a);
+	}
+	state.items(a.size());
+}
+BENCHMARK(fpx_transpose_rect, 10, 100, 1000, 2000);
+
+void fpx_sum(bench::state& state)
+{
+	const FPX a = iota(static_cast<int32_t>(state.range()), 1);
+	for ([[maybe_unused]] auto _ : state) {
+		double s = sum(*a.get());
+		bench::keep(s);
+	}
+	state.items(state.range());
+}
+BENCHMARK(fpx_sum, 1000, 100'000, 1'000'000);
+
+void fpx_sum_scalar(bench::state& state)
+{
+	const int level = fpx_simd(-1);
+	fpx_simd(0);
+	fpx_sum(state);
+	fpx_simd(level);
+}
+BENCHMARK(fpx_sum_scalar, 1000, 100'000, 1'000'000);
+
+// Baseline for fpx_sum.
+void std_accumulate(bench::state& state)
+{
+	const FPX a = iota(static_cast<int32_t>(state.range()), 1);
+	for ([[maybe_unused]] auto _ : state) {
+		double s = std::accumulate(a.array(), a.array() + a.size(), 0.);
+		bench::keep(s);
+	}
+	state.items(state.range());
+}
+BENCHMARK(std_accumulate, 1000, 100'000, 1'000'000);
+
+void fpx_dot(bench::state& state)
+{
+	const FPX a = iota(static_cast<int32_t>(state.range()), 1);
+	for ([[maybe_unused]] auto _ : state) {
+		double s = dot(*a.get(), *a.get());
+		bench::keep(s);
+	}
+	state.items(state.range());
+}
+BENCHMARK(fpx_dot, 1000, 100'000, 1'000'000);
+
+void fpx_axpy(bench::state& state)
+{
+	const FPX x = iota(static_cast<int32_t>(state.range()), 1);
+	FPX y = iota(static_cast<int32_t>(state.range()), 1);
+	for ([[maybe_unused]] auto _ : state) {
+		axpy(1e-9, *x.get(), *y.get());
+		bench::keep(y);
+	}
+	state.items(state.range());
+}
+BENCHMARK(fpx_axpy, 1000, 100'000, 1'000'000);
+
+// Pass a range of n strings to a function that ignores it.
+void excel_arg_range(bench::state& state)
+{
+	const OPER o = strs(static_cast<int>(state.range()));
+	auto old = host::on(xlfNow, [](int, LPXLOPER12*, LPXLOPER12 res) {
+		res->xltype = xltypeNum;
+		res->val.num = 0;
+		return xlretSuccess;
+		});
+	for ([[maybe_unused]] auto _ : state) {
+		bench::keep(Excel(xlfNow, o));
+	}
+	host::on(xlfNow, old);
+	state.items(state.range());
+}
+BENCHMARK(excel_arg_range, 16, 1024, 1 << 16);
+
+// Read a range of n strings returned by Excel.
+template<class R>
+void excel_result_(bench::state& state)
+{
+	const OPER o = strs(static_cast<int>(state.range()));
+	auto old = host::on(xlfNow, [&o](int, LPXLOPER12*, LPXLOPER12 res) {
+		host::result(res, o);
+		return xlretSuccess;
+		});
+	for ([[maybe_unused]] auto _ : state) {
+		const R r = Excel<R>(xlfNow);
+		bench::keep(r.val.array.lparray[0]);
+	}
+	host::on(xlfNow, old);
+	state.items(state.range());
+}
+void excel_result_oper(bench::state& state)
+{
+	excel_result_<OPER>(state);
+}
+BENCHMARK(excel_result_oper, 16, 1024, 1 << 16);
+void excel_result_xlfree(bench::state& state)
+{
+	excel_result_<xlfree>(state);
+}
+BENCHMARK(excel_result_xlfree, 16, 1024, 1 << 16);
+
+// Find one of n registered add-ins by name.
+template<bool indexed>
+void addin_find_(bench::state& state)
+{
+	const int n = static_cast<int>(state.range());
+	std::vector<Args> args(n);
+	for (int i = 0; i < n; ++i) {
+		args[i].functionText = OPER(L"XLL.BENCH.") & OPER(std::to_wstring(i));
+		args[i].procedure = OPER(L"?xll_bench_") & OPER(std::to_wstring(i));
+		const OPER regid = Excel(xlfRegister, OPER(L"bench"), args[i].procedure, OPER(L"B"), args[i].functionText);
+		xll::registry::instance().insert(&args[i], Num(regid));
+	}
+	int i = 0;
+	for ([[maybe_unused]] auto _ : state) {
+		const auto& text = args[i].functionText;
+		bench::keep(indexed ? xll::registry::instance().find(text) : xll::registry::instance().find(RegId(text)));
+		i = i + 1 == n ? 0 : i + 1;
+	}
+	for (const auto& a : args) {
+		Excel(xlfUnregister, OPER(xll::registry::instance().regid(a.functionText)));
+		xll::registry::instance().erase(a.functionText);
+	}
+}
+void addin_find_evaluate(bench::state& state)
+{
+	addin_find_<false>(state);
+}
+BENCHMARK(addin_find_evaluate, 16, 1024);
+void addin_find_indexed(bench::state& state)
+{
+	addin_find_<true>(state);
+}
+BENCHMARK(addin_find_indexed, 16, 1024);
+
+// Lay out n label/value rows the way a sheet builder macro does.
+template<bool batched>
+void macro_layout_(bench::state& state)
+{
+	const auto n = static_cast<RW>(state.range());
+	for ([[maybe_unused]] auto _ : state) {
+		std::optional<command_batch> batch;
+		if constexpr (batched) {
+			batch.emplace();
+		}
+		for (RW i = 0; i < n; ++i) {
+			command(xlcSelect, OPER(REF(i, 0)));
+			command(xlSet, OPER(REF(i, 0)), OPER(L"label"));
+			command(xlSet, OPER(REF(i, 1)), OPER(i));
+		}
+	}
+}
+void macro_layout_direct(bench::state& state)
+{
+	macro_layout_<false>(state);
+}
+BENCHMARK(macro_layout_direct, 16, 256);
+void macro_layout_batch(bench::state& state)
+{
+	macro_layout_<true>(state);
+}
+BENCHMARK(macro_layout_batch, 16, 256);
+
+// Create a handle in one of n cells, deleting the one it replaces.
+// Replaced objects are reclaimed after every n like a recalc.
+void handle_create(bench::state& state)
+{
+	const auto n = static_cast<RW>(state.range());
+	RW i = 0;
+	for ([[maybe_unused]] auto _ : state) {
+		host::caller() = OPER(REF(i, 0));
+		handle<base> h(new base(i));
+		host::cell(i, 0) = h.get();
+		i = i + 1 == n ? 0 : i + 1;
+		if (i == 0) {
+			retired::reclaim();
+		}
+	}
+	host::caller() = OPER(REF(0, 0));
+	retired::reclaim();
+}
+BENCHMARK(handle_create, 1, 1024);
+
+// Same as handle_create using the object pool.
+void handle_make(bench::state& state)
+{
+	const auto n = static_cast<RW>(state.range());
+	RW i = 0;
+	for ([[maybe_unused]] auto _ : state) {
+		host::caller() = OPER(REF(i, 0));
+		auto h = handle<base>::make(i);
+		host::cell(i, 0) = h.get();
+		i = i + 1 == n ? 0 : i + 1;
+		if (i == 0) {
+			retired::reclaim();
+		}
+	}
+	host::caller() = OPER(REF(0, 0));
+	retired::reclaim();
+}
+BENCHMARK(handle_make, 1, 1024);
+
+// Look up one of n live handles from another cell.
+template<class H>
+void handle_lookup_(bench::state& state)
+{
+	const auto n = static_cast<RW>(state.range());
+	std::vector<HANDLEX> hs(n);
+	for (RW i = 0; i < n; ++i) {
+		host::caller() = OPER(REF(i, 0));
+		H h(new base(i));
+		hs[i] = h.get();
+		host::cell(i, 0) = hs[i];
+	}
+	host::caller() = OPER(REF(0, 1));
+	RW i = 0;
+	for ([[maybe_unused]] auto _ : state) {
+		H h_(hs[i]);
+		bench::keep(h_->x);
+		i = i + 1 == n ? 0 : i + 1;
+	}
+	host::caller() = OPER(REF(0, 0));
+	retired::reclaim(); // replaced by the next run
+}
+void handle_lookup(bench::state& state)
+{
+	handle_lookup_<handle<base>>(state);
+}
+BENCHMARK(handle_lookup, 1, 1024, 1 << 16);
+void handle_lookup_slots(bench::state& state)
+{
+	handle_lookup_<slot_handle<base>>(state);
+}
+BENCHMARK(handle_lookup_slots, 1, 1024, 1 << 16);
+
+// Function taking three handles. Argument 0 has no caller_scope,
+// 1 calls xlfCaller once per call, 2 only looks up handles.
+void handle_udf(bench::state& state)
+{
+	HANDLEX hs[3];
+	for (RW i = 0; i < 3; ++i) {
+		host::caller() = OPER(REF(i, 2));
+		handle<base> h(new base(i));
+		hs[i] = h.get();
+		host::cell(i, 2) = hs[i];
+	}
+	host::caller() = OPER(REF(0, 3));
+	const auto udf = [&hs]() {
+		handle<base> a(hs[0]), b(hs[1]), c(hs[2]);
+
+		return a->x + b->x + c->x;
+	};
+	for ([[maybe_unused]] auto _ : state) {
+		if (state.range() == 0) {
+			bench::keep(udf());
+		}
+		else {
+			caller_scope scope(state.range() == 1);
+			bench::keep(udf());
+		}
+	}
+	host::caller() = OPER(REF(0, 0));
+	retired::reclaim();
+}
+BENCHMARK(handle_udf, 0, 1, 2);
+
+// Look up 1024 live handles from t threads at once.
+void handle_lookup_threads(bench::state& state)
+{
+	constexpr RW n = 1024;
+	std::vector<HANDLEX> hs(n);
+	for (RW i = 0; i < n; ++i) {
+		host::caller() = OPER(REF(i, 0));
+		handle<base> h(new base(i));
+		hs[i] = h.get();
+		host::cell(i, 0) = hs[i];
+	}
+	host::caller() = OPER(REF(0, 0));
+
+	const auto m = state.iterations();
+	std::vector<std::thread> ts;
+	state.resume();
+	for (int64_t t = 0; t < state.range(); ++t) {
+		ts.emplace_back([&hs, m, t] {
+			host::caller() = OPER(REF(0, 1));
+			RW i = static_cast<RW>(t * 97 % n);
+			for (int64_t k = 0; k < m; ++k) {
+				handle<base> h_(hs[i]);
+				bench::keep(h_->x);
+				i = i + 1 == n ? 0 : i + 1;
+			}
+		});
+	}
+	for (auto& t : ts) {
+		t.join();
+	}
+	state.pause();
+	retired::reclaim();
+	state.items(state.range());
+}
+BENCHMARK(handle_lookup_threads, 1, 2, 4, 8, 16, 32, 64);
+
+int main(int argc, char** argv)
+{
+	std::regex filter(".*");
+	double min_time = 0.5;
+	std::string format = "console";
+	FILE* out = stdout;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg(argv[i]);
+		const auto eq = arg.find('=');
+		const auto key = arg.substr(0, eq);
+		const auto value = eq == std::string::npos ? std::string{} : arg.substr(eq + 1);
+		if (key == "--benchmark_filter") {
+			filter = std::regex(value);
+		}
+		else if (key == "--benchmark_min_time") {
+			min_time = std::stod(value);
+		}
+		else if (key == "--benchmark_format") {
+			format = value;
+		}
+		else if (key == "--benchmark_out") {
+			out = fopen(value.c_str(), "w");
+			if (!out) {
+				fprintf(stderr, "xll_bench: cannot open %s\n", value.c_str());
+
+				return 1;
+			}
+		}
+		else {
+			fprintf(stderr, "usage: %s [--benchmark_filter=regex] [--benchmark_min_time=seconds]"
+				" [--benchmark_format=console|json|csv] [--benchmark_out=file]\n", argv[0]);
+
+			return 1;
+		}
+	}
+
+	host::install();
+
+	std::vector<bench::result> rs;
+	try {
+		for (const auto& b : bench::registry()) {
+			for (auto arg : b.args) {
+				if (std::regex_search(b.name + "/" + std::to_string(arg), filter)) {
+					rs.push_back(bench::run(b, arg, min_time));
+				}
+			}
+		}
+	}
+	catch (const std::exception& ex) {
+		fprintf(stderr, "xll_bench: %s\n", ex.what());
+
+		return 1;
+	}
+
+	if (format == "json") {
+		bench::json(out, rs);
+	}
+	else if (format == "csv") {
+		bench::csv(out, rs);
+	}
+	else {
+		bench::console(out, rs);
+	}
+	if (out != stdout) {
+		fclose(out);
+	}
+
+	return 0;
+}
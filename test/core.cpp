@@ -0,0 +1,976 @@
+// core.cpp - headless tests of the portable core using the Excel stand-in.
+// Copyright (c) KALX, LLC. All rights reserved. No warranty made.
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "host.h"
+#include "addin.h"
+#include "enum.h"
+#include "fp.h"
+#include "handle.h"
+#include "macrofun.h"
+
+using namespace xll;
+
+int oper_test()
+{
+	{
+		OPER o(2, 3);
+		o[0] = o;
+		OPER p = compress(o);
+		OPER q = expand(p);
+		ensure(o == q);
+		{
+			OPER p_(p); // copies do not own nested handles
+		}
+		ensure(o == expand(p));
+		OPER h(p[0]);
+		h = OPER(); // destroying a number does not free nested handles
+		ensure(o == expand(p));
+	}
+	{
+		// long strings of a copied range live in the multi
+		const OPER range({ OPER(1.), OPER(L"a longer string"), OPER(L""), OPER(true) });
+		OPER o(range);
+		ensure(storage(o[1]) == str_storage::pool);
+		ensure(storage(o[2]) == str_storage::local);
+		OPER s = std::move(o[1]);
+		ensure(s == L"a longer string");
+		ensure(storage(s) == str_storage::heap);
+		o[2] = OPER(L"de");
+		ensure(storage(o[2]) == str_storage::local);
+		OPER o2(o);
+		ensure(o2 == o);
+		std::swap(o2[1], o2[2]);
+		ensure(o2[1] == L"de");
+	}
+	{
+		OPER o;
+		o.reserve(10);
+		ensure(o.capacity() == 10);
+		ensure(size(o) == 0);
+		for (int i = 0; i < 100; ++i) {
+			o.append(OPER(i));
+		}
+		ensure(rows(o) == 1);
+		ensure(columns(o) == 100);
+		ensure(o.capacity() >= 100);
+		ensure(o[99] == 99);
+		o.append(o[0]);
+		ensure(o[100] == 0);
+	}
+	{
+		OPER o;
+		for (int i = 0; i < 100; ++i) {
+			o.vstack(OPER(i));
+		}
+		ensure(rows(o) == 100);
+		ensure(columns(o) == 1);
+		ensure(o[99] == 99);
+	}
+	{
+		// move an element of o to the end of o
+		const std::wstring s(OPER::local_max + 10, L'x');
+		OPER o(2, 1);
+		o[0] = OPER(s);
+		o[1] = OPER(1.);
+		o.vstack(std::move(o[0]));
+		ensure(rows(o) == 3);
+		ensure(o[2] == OPER(s));
+		OPER h({ OPER(s), OPER(1.) });
+		h.hstack(std::move(h[0]));
+		ensure(columns(h) == 3);
+		ensure(h[2] == OPER(s));
+	}
+	{
+		OPER o({ OPER(1), OPER(L"a"), OPER(true), OPER(2), OPER(L"b"), OPER(false) });
+		o.reshape(2, 3);
+		OPER t(o);
+		t.transpose();
+		ensure(rows(t) == 3);
+		ensure(columns(t) == 2);
+		for (int i = 0; i < rows(o); ++i) {
+			for (int j = 0; j < columns(o); ++j) {
+				ensure(t(j, i) == o(i, j));
+			}
+		}
+
+		OPER h(o);
+		h.hstack(t.transpose());
+		ensure(rows(h) == 2);
+		ensure(columns(h) == 6);
+		ensure(h(1, 2) == false);
+		ensure(h(1, 3) == 2);
+		ensure(h(1, 5) == false);
+		h.hstack(OPER(3, 1));
+		ensure(h == ErrValue);
+	}
+	{
+		// nested handles move with the elements that hold them
+		OPER n(2, 1);
+		n[0] = OPER({ OPER(1.), OPER(L"x") });
+		n[1] = OPER(2.);
+		const size_t live = handles::map().size();
+		{
+			OPER v(1, 1);
+			v.vstack(compress(n));
+			OPER h(2, 1);
+			h.hstack(compress(n));
+			OPER a({ OPER(0.), OPER(1.) });
+			a.append(compress(n));
+			ensure(handles::map().size() == live + 3);
+			ensure(expand(v)[1] == n[0] && expand(h)(0, 1) == n[0] && expand(a[2]) == n);
+		}
+		ensure(handles::map().size() == live);
+	}
+	{
+		// short strings do not prevent copying into one block
+		OPER o({ OPER(L"a string of 20 chars"), OPER(1.0), OPER(L"ab"), OPER(L"") });
+		OPER o2(o);
+		ensure(o2 == o);
+		ensure(storage(o2[0]) == str_storage::pool);
+		ensure(storage(o2[2]) == str_storage::local);
+		ensure(storage(o2[3]) == str_storage::local);
+	}
+	{
+		OPER o("abc");
+		ensure(o == L"abc");
+		o &= OPER(L"é");
+		ensure(count(o) == 4);
+		ensure(utf8::wcstostring(OPER(L"é").val.str + 1, 1) == "\xc3\xa9");
+	}
+	{
+		OPER o({ OPER(1.5), OPER(L"x"), OPER(true) });
+		ensure(size(o) == 3);
+		OPER o2(o);
+		ensure(o2 == o);
+		o2.resize(3, 1);
+		ensure(rows(o2) == 3);
+		ensure(o2[1] == L"x");
+	}
+	{
+		// short strings live in the OPER
+		OPER o(L"B");
+		ensure(storage(o) == str_storage::local);
+		OPER o2(std::move(o));
+		ensure(o2 == L"B");
+		ensure(storage(o2) == str_storage::local);
+		const std::wstring s(OPER::local_max + 1, L'x');
+		ensure(storage(OPER(s)) == str_storage::heap);
+
+		// survive relocation of the elements of a multi
+		OPER a;
+		for (int i = 0; i < 100; ++i) {
+			a.append(i % 2 ? OPER(L"B") : OPER(s));
+		}
+		ensure(a[99] == L"B");
+		a.resize(10, 10);
+		a.transpose();
+		ensure(a(9, 0) == L"B" && a(0, 1) == OPER(s));
+		a.hstack(a);
+		ensure(columns(a) == 20);
+		ensure(a(9, 10) == L"B" && storage(a(9, 10)) == str_storage::local);
+		OPER a2(a);
+		ensure(a2 == a);
+	}
+
+	return 0;
+}
+
+int arena_test()
+{
+	const std::wstring s(OPER::local_max + 10, L'x');
+	OPER* po = arena_oper(100, 1);
+	for (int i = 0; i < size(*po); ++i) {
+		(*po)[i] = OPER(s);
+	}
+	ensure(storage((*po)[99]) == str_storage::arena);
+	po->append(OPER(s)); // grow within the arena
+	ensure(rows(*po) == 101);
+	ensure(arena::local().used() > 0);
+	// other OPERs never use the arena
+	ensure(storage(OPER(s)) == str_storage::heap);
+	{
+		// moving out of the arena copies
+		OPER str(std::move((*po)[0]));
+		ensure(storage(str) == str_storage::heap);
+		OPER o(*po);
+		ensure(o == *po);
+		ensure(storage(o[100]) != str_storage::arena);
+		OPER multi;
+		multi = std::move(*po);
+		ensure(storage(multi[100]) != str_storage::arena);
+		arena::release();
+		ensure(arena::local().used() > 0); // until the next arena_oper
+		OPER* pn = arena_oper(101, 1);
+		ensure(arena::local().used() == sizeof(OPER) + sizeof(XLOPER12) * 102);
+		for (OPER& oi : *pn) {
+			oi = OPER(std::wstring(s.size(), L'y'));
+		}
+		ensure(str == OPER(s));
+		ensure(multi == o);
+	}
+
+	return 0;
+}
+
+int result_test()
+{
+	XLL_RESULT(o);
+	o = OPER(L"main");
+	OPER* p = &o;
+	OPER* q = nullptr;
+	std::thread([&q] {
+		XLL_RESULT(o);
+		o = OPER(L"thread");
+		q = &o;
+	}).join();
+	ensure(q != p);
+	ensure(*p == L"main");
+
+	// ring of slots per thread
+	struct tag;
+	OPER* r0 = &result_slot<tag, 2>();
+	OPER* r1 = &result_slot<tag, 2>();
+	ensure(r0 != r1);
+	ensure(r0 == (&result_slot<tag, 2>()));
+
+	return 0;
+}
+
+int excel_test()
+{
+	{
+		ensure(Excel(xlfEvaluate, OPER(L"1.5")) == 1.5);
+		ensure(Excel(xlfEvaluate, OPER(L"not.defined")) == ErrName);
+		ensure(isStr(Excel(xlGetName)));
+	}
+	{
+		Excel(xlfSetName, OPER(L"foo"), OPER(L"bar"));
+		ensure(Excel(xlfEvaluate, OPER(L"=FOO")) == L"bar");
+		Excel(xlfSetName, OPER(L"foo"));
+		ensure(Excel(xlfEvaluate, OPER(L"=foo")) == ErrName);
+	}
+	{
+		// replace a handler
+		auto old = host::on(xlfNow, [](int, LPXLOPER12*, LPXLOPER12 res) {
+			host::result(res, OPER(42.));
+			return xlretSuccess;
+			});
+		ensure(!old);
+		ensure(Excel(xlfNow) == 42);
+		host::on(xlfNow, old);
+		bool failed = false;
+		try {
+			Excel(xlfNow);
+		}
+		catch (const std::exception&) {
+			failed = true;
+		}
+		ensure(failed);
+	}
+	{
+		// XLOPER12 arguments are passed without copying
+		const OPER s(L"a string that is not short");
+		const XLOPER12* arg = nullptr;
+		auto old = host::on(xlfNow, [&arg](int, LPXLOPER12* opers, LPXLOPER12 res) {
+			arg = opers[0];
+			host::result(res, *opers[0]);
+			return xlretSuccess;
+			});
+		ensure(Excel(xlfNow, s) == s);
+		ensure(arg == &s);
+		ensure(Excel(xlfNow, L"abc") == L"abc");
+
+		// adopt the result
+		size_t calls = host::calls();
+		{
+			const xlfree x = Excel<xlfree>(xlfNow, s);
+			ensure(x.owner() && x.xltype == xltypeStr);
+			ensure(view(x) == view(s));
+
+			// and pass it back without the free bit
+			const xlfree y = Excel<xlfree>(xlfNow, x);
+			ensure(arg == &x && arg->xltype == xltypeStr);
+			ensure(view(y) == view(s));
+		}
+		ensure(host::calls() == calls + 4); // 2 xlfNow and 2 xlFree
+		host::on(xlfNow, old);
+
+		// OPER frees results owned by Excel
+		XLOPER12 res{};
+		res.xltype = xltypeNil;
+		host::result(&res, s);
+		OPER o;
+		static_cast<XLOPER12&>(o) = res;
+		calls = host::calls();
+		o = OPER();
+		ensure(host::calls() == calls + 1);
+	}
+
+	return 0;
+}
+
+AddIn xai_core_test(
+	Function(XLL_DOUBLE, L"xll_core_test", L"XLL.CORE.TEST")
+	.Arguments({
+		Arg(XLL_DOUBLE, L"x", L"is a number."),
+		})
+	.FunctionHelp(L"Return x.")
+	.Category(L"XLL")
+);
+
+int batch_test()
+{
+	size_t calls = host::calls();
+	{
+		command_batch batch;
+		for (RW i = 0; i < 10; ++i) {
+			command(xlcSelect, OPER(REF(20 + i, 0)));
+			command(xlSet, OPER(REF(20 + i, 0)), OPER(i));
+			command(xlSet, OPER(REF(20 + i, 1, 1, 2)), OPER(L"x"));
+		}
+		ensure(host::calls() == calls);
+		batch.flush();
+		ensure(batch.recorded() == 30);
+		ensure(batch.issued() == 2); // last xlcSelect and one xlSet
+	}
+	ensure(host::calls() == calls + 2);
+	ensure(host::cell(29, 0) == 9 && host::cell(25, 2) == L"x");
+
+	// overlapping writes keep their order
+	{
+		command_batch batch;
+		command(xlSet, OPER(REF(40, 0, 1, 2)), OPER(1.));
+		command(xlSet, OPER(REF(40, 1)), OPER(2.));
+		command(xlcSelect, OPER(REF(40, 0)));
+		command(xlcSelect, OPER(REF(40, 0)));
+		batch.flush();
+		ensure(batch.issued() == 3);
+	}
+	ensure(host::cell(40, 0) == 1 && host::cell(40, 1) == 2);
+
+	// without a batch commands are called immediately
+	calls = host::calls();
+	command(xlcSelect, OPER(REF(0, 0)));
+	ensure(host::calls() == calls + 1);
+
+	return 0;
+}
+
+int suspend_test()
+{
+	ensure(Excel(xlfGetWorkspace, 40) == true);
+	ensure(Excel(xlfGetDocument, 14) == 1);
+	{
+		Suspend suspend;
+		ensure(Excel(xlfGetWorkspace, 40) == false);
+		ensure(Excel(xlfGetDocument, 14) == 3);
+		{
+			Suspend inner(true, Suspend::Calculation::AutomaticExceptTables);
+			ensure(Excel(xlfGetWorkspace, 40) == true);
+			ensure(Excel(xlfGetDocument, 14) == 2);
+		}
+		ensure(Excel(xlfGetWorkspace, 40) == false);
+		ensure(Excel(xlfGetDocument, 14) == 3);
+	}
+	ensure(Excel(xlfGetWorkspace, 40) == true);
+	ensure(Excel(xlfGetDocument, 14) == 1);
+
+	// restored on exceptions after queued commands are issued
+	try {
+		Suspend suspend;
+		command_batch batch;
+		command(xlSet, OPER(REF(50, 0)), OPER(1.));
+		throw std::runtime_error("suspend_test");
+	}
+	catch (const std::runtime_error&) {
+	}
+	ensure(host::cell(50, 0) == 1);
+	ensure(Excel(xlfGetWorkspace, 40) == true);
+	ensure(Excel(xlfGetDocument, 14) == 1);
+
+	// nothing to restore if already suspended
+	size_t calls = host::calls();
+	{
+		Suspend suspend(true, Suspend::Calculation::Automatic);
+	}
+	ensure(host::calls() == calls + 2);
+
+	return 0;
+}
+
+AddIn xai_core_uncalced(
+	Function(XLL_DOUBLE, L"xll_core_uncalced", L"XLL.CORE.UNCALCED")
+	.Arguments({})
+	.Uncalced()
+	.FunctionHelp(L"Return a different value each call.")
+	.Category(L"XLL")
+);
+
+AddIn xai_core_enum(
+	Function(XLL_DOUBLE, L"xll_core_enum", L"XLL.CORE.ENUM")
+	.Arguments({})
+	.FunctionHelp(L"Return 42.")
+	.Category(L"XLL")
+);
+
+int enum_test()
+{
+	ensure(Auto<Register>::Call());
+	std::atomic<int> evaluations = 0;
+	auto evaluate = host::on(xlfEvaluate, nullptr);
+	host::on(xlfEvaluate, [&](int count, LPXLOPER12* opers, LPXLOPER12 res) {
+		++evaluations;
+		if (count > 0 && view(*opers[0]) == L"=XLL.CORE.ENUM()") {
+			host::result(res, OPER(42.));
+
+			return static_cast<int>(xlretSuccess);
+		}
+		if (count > 0 && view(*opers[0]) == L"=XLL.CORE.UNCALCED()") {
+			host::result(res, OPER(double(evaluations)));
+
+			return static_cast<int>(xlretSuccess);
+		}
+
+		return evaluate(count, opers, res);
+	});
+
+	// names resolve without Excel
+	ensure(isUDF(OPER(L"=xll.core.test")));
+	ensure(!isUDF(OPER(L"XLL.NOT.DEFINED")));
+	ensure(!isUDF(OPER(registry::instance().regid(OPER(L"XLL.CORE.TEST")))));
+	ensure(isEnum(OPER(L"XLL.CORE.ENUM")));
+	ensure(!isEnum(OPER(L"XLL.CORE.TEST")));
+	ensure(evaluations == 0);
+
+	// constant values are evaluated once
+	ensure(Eval(OPER(L"XLL.CORE.ENUM")) == 42);
+	ensure(evaluations == 1);
+	ensure(EnumVal<int>(OPER(L"xll.core.enum"), 0) == 42);
+	ensure(Eval(OPER(L"=XLL.CORE.ENUM")) == 42);
+	ensure(evaluations == 1);
+
+	// uncalced functions are evaluated every time
+	ensure(Eval(OPER(L"XLL.CORE.UNCALCED")) != Eval(OPER(L"XLL.CORE.UNCALCED")));
+	ensure(evaluations == 3);
+
+	// unregistering forgets names and values
+	ensure(Auto<Unregister>::Call());
+	ensure(!isEnum(OPER(L"XLL.CORE.ENUM")));
+	ensure(Eval(OPER(L"XLL.CORE.ENUM")) == L"XLL.CORE.ENUM");
+	ensure(registry::instance().size() == 0);
+	host::on(xlfEvaluate, evaluate);
+
+	return 0;
+}
+
+int addin_test()
+{
+	ensure(Auto<Register>::Call());
+	Args* pargs = AddIn::find(OPER(L"XLL.CORE.TEST"));
+	ensure(pargs);
+	ensure(view(pargs->procedure).ends_with(L"xll_core_test"));
+	ensure(AddIn::find(OPER(L"XLL.NOT.DEFINED")) == nullptr);
+	// indexed by register id and procedure
+	const double regid = registry::instance().regid(OPER(L"xll.core.test"));
+	ensure(AddIn::find(OPER(regid)) == pargs);
+	ensure(registry::instance().procedure(OPER(L"xll_core_test")) == pargs);
+	ensure(registry::instance().procedure(pargs->procedure) == pargs);
+	const auto ids = RegIds();
+	ensure(std::ranges::is_sorted(ids, {}, &std::pair<double, Args*>::first));
+	ensure(std::ranges::find(ids, std::pair<double, Args*>(regid, pargs)) != ids.end());
+	ensure(Auto<Unregister>::Call());
+	ensure(AddIn::find(OPER(regid)) == nullptr);
+	ensure(registry::instance().procedure(OPER(L"xll_core_test")) == nullptr);
+	ensure(AddIn::find(OPER(L"XLL.CORE.TEST")) == nullptr);
+
+	return 0;
+}
+
+struct base {
+	inline static std::atomic<int> live = 0;
+	int x;
+	base(int x = 0) : x(x) { ++live; }
+	virtual ~base() { --live; }
+};
+
+int handle_test()
+{
+	host::caller() = OPER(REF(1, 2));
+	{
+		handle<base> h(new base(1));
+		ensure(h);
+		HANDLEX x = h.get();
+		host::cell(1, 2) = x;
+
+		// look up from another cell
+		host::caller() = OPER(REF(5, 5));
+		handle<base> h_(x);
+		ensure(h_);
+		ensure(h_->x == 1);
+
+		// new handle in the same cell deletes the old one
+		host::caller() = OPER(REF(1, 2));
+		handle<base> h2(new base(2));
+		ensure(h2->x == 2);
+		ensure(!handle<base>(x));
+		host::cell(1, 2) = h2.get();
+
+		// deleted when calculation ends
+		ensure(base::live == 2);
+		retired::reclaim();
+		ensure(base::live == 1);
+	}
+	{
+		// look up from many threads while handles are replaced
+		constexpr RW n = 64;
+		std::vector<HANDLEX> hs(n);
+		for (RW i = 0; i < n; ++i) {
+			host::caller() = OPER(REF(i, 3));
+			handle<base> h(new base(i));
+			hs[i] = h.get();
+			host::cell(i, 3) = hs[i];
+		}
+		std::atomic<int> bad = 0;
+		std::vector<std::thread> ts;
+		for (int t = 0; t < 8; ++t) {
+			ts.emplace_back([&hs, &bad] {
+				host::caller() = OPER(REF(0, 9));
+				for (int k = 0; k < 10'000; ++k) {
+					handle<base> h_(hs[k % n]);
+					if (h_ && h_->x != k % n) {
+						++bad;
+					}
+				}
+			});
+		}
+		for (RW i = 0; i < n; i += 2) {
+			host::caller() = OPER(REF(i, 3));
+			handle<base> h(new base(i));
+			host::cell(i, 3) = h.get();
+		}
+		for (auto& t : ts) {
+			t.join();
+		}
+		ensure(bad == 0);
+		ensure(handle<base>::size() == n + 1);
+		ensure(retired::reclaim() == n / 2);
+	}
+	{
+		host::caller() = OPER(REF(7, 7));
+		const HANDLEX x = handle<base>(new base(7)).get();
+		const HANDLEX y = handle<base>(new base(8)).get();
+		host::cell(7, 7) = y;
+
+		// one xlfCaller per scope
+		host::caller() = OPER(REF(5, 5));
+		size_t calls = host::calls();
+		{
+			caller_scope scope;
+			ensure(handle<base>(x)->x + handle<base>(y)->x == 15);
+		}
+		ensure(host::calls() == calls + 1);
+
+		// lookup only
+		host::caller() = OPER(REF(7, 7));
+		calls = host::calls();
+		{
+			caller_scope scope(false);
+			ensure(handle<base>(x)->x == 7);
+		}
+		ensure(host::calls() == calls);
+
+		// not temporary unless checked
+		{
+			handle<base> h_(x);
+			ensure(h_.is_temporary());
+		}
+		ensure(!handle<base>(x));
+		retired::reclaim();
+	}
+	{
+		struct derived : base {
+			double y;
+			derived(int x, double y) : base(x), y(y) {}
+		};
+		auto& pool = object_pool<derived>::instance();
+		host::caller() = OPER(REF(8, 8));
+		auto h = handle<base>::make<derived>(1, 2.);
+		ensure(h->x == 1 && h.as<derived>()->y == 2);
+		ensure(pool.size() == 1);
+		const derived* p = h.as<derived>();
+		host::cell(8, 8) = h.get();
+
+		// storage is reused once the old object is reclaimed
+		handle<base>::make<derived>(3, 4.);
+		ensure(pool.size() == 2);
+		ensure(retired::reclaim() == 1);
+		ensure(pool.size() == 1);
+		host::cell(8, 8) = OPER();
+		auto h2 = handle<base>::make<derived>(5, 6.);
+		ensure(h2.as<derived>() == p);
+		ensure(pool.capacity() >= 2);
+	}
+	{
+		// sweep handles no longer in the cell that created them
+		struct leaf : base { };
+		HANDLEX hs[4];
+		for (RW i = 0; i < 3; ++i) {
+			host::caller() = OPER(REF(10 + i, 0));
+			hs[i] = handle<leaf>(new leaf).get();
+			host::cell(10 + i, 0) = hs[i];
+		}
+		host::caller() = ErrRef; // not created by a cell
+		hs[3] = handle<leaf>(new leaf).get();
+		host::cell(10, 0) = 1.5; // overwritten
+		host::cell(11, 0) = OPER(); // deleted
+		const auto s = handle<leaf>::sweep();
+		ensure(s.handles == 4 && s.swept == 2);
+		ensure(s.bytes == 2 * sizeof(leaf));
+		ensure(!handle<leaf>(hs[0]) && !handle<leaf>(hs[1]));
+		ensure(handle<leaf>(hs[2]) && handle<leaf>(hs[3]));
+		ensure(handle_gc::sweep().handles >= 2);
+		ensure(handle_gc::total().swept >= 2);
+		retired::reclaim();
+	}
+	{
+		// inserting a row moves creating cells without recalculating them
+		struct moved : base { };
+		host::caller() = OPER(REF(14, 0));
+		const HANDLEX x = handle<moved>(new moved).get();
+		host::caller() = OPER(REF(15, 0));
+		const HANDLEX y = handle<moved>(new moved).get();
+		host::cell(14, 0) = OPER();
+		host::cell(15, 0) = x;
+		host::cell(16, 0) = y;
+		ensure(handle<moved>::sweep().swept == 0);
+		host::caller() = OPER(REF(5, 5));
+		ensure(handle<moved>(x) && handle<moved>(y));
+
+		// a text constant does not hold a handle, a string encoding it does
+		host::cell(15, 0) = OPER(L"overwritten with text");
+		handle<moved>::codec c("moved[", "]");
+		host::cell(16, 0) = c.encode(y);
+		const auto s = handle<moved>::sweep();
+		ensure(s.handles == 2 && s.swept == 1);
+		ensure(!handle<moved>(x) && handle<moved>(y));
+		retired::reclaim();
+	}
+	{
+		struct counted : base { };
+		host::caller() = OPER(REF(12, 1));
+		const HANDLEX x = handle<counted>(new counted).get();
+		host::cell(12, 1) = x;
+		host::caller() = OPER(REF(12, 2));
+		for (unsigned i = 0; i < 2 * handle_stats::sample; ++i) {
+			ensure(handle<counted>(x));
+		}
+		ensure(!handle<counted>(x + 16));
+		const auto& c = handle<counted>::stats();
+		ensure(c.created == 1 && c.erased == 0 && c.misses == 1);
+		ensure(c.lookups >= handle_stats::sample);
+		ensure(handle_stats::quantile(c, 0.99) > 0);
+
+		const OPER t = handle_stats::table();
+		ensure(t(0, 0) == L"Type");
+		int row = 0;
+		for (int i = 1; i < rows(t); ++i) {
+			if (t(i, 0) == OPER(typeid(counted).name())) {
+				row = i;
+			}
+		}
+		ensure(row && t(row, 1) == 1 && t(row, 2) == sizeof(counted));
+	}
+	{
+		// interleaved lookups of two types are sampled for both
+		struct even : base { };
+		struct odd : base { };
+		host::caller() = OPER(REF(13, 1));
+		const HANDLEX x = handle<even>(new even).get();
+		host::cell(13, 1) = x;
+		host::caller() = OPER(REF(13, 2));
+		const HANDLEX y = handle<odd>(new odd).get();
+		host::cell(13, 2) = y;
+		host::caller() = OPER(REF(13, 3));
+		for (unsigned i = 0; i < 2 * handle_stats::sample; ++i) {
+			ensure(handle<even>(x) && handle<odd>(y));
+		}
+		ensure(handle<even>::stats().lookups == 2 * handle_stats::sample);
+		ensure(handle<odd>::stats().lookups == 2 * handle_stats::sample);
+	}
+	{
+		// Excel failing while creating a handle deletes the object
+		const int live = base::live;
+		const auto old = host::on(xlfCaller, [](int, LPXLOPER12*, LPXLOPER12) { return xlretFailed; });
+		handle<base> h(new base(1));
+		host::on(xlfCaller, old);
+		ensure(!h);
+		ensure(base::live == live);
+	}
+	{
+		host::caller() = OPER(REF(2, 4));
+		slot_handle<base> h(new base(1));
+		const HANDLEX x = h.get();
+		ensure(x == std::floor(x) && x < 0x1p53);
+		host::cell(2, 4) = x;
+
+		host::caller() = OPER(REF(5, 5));
+		ensure(slot_handle<base>(x)->x == 1);
+		ensure(!slot_handle<base>(x + 1));
+		ensure(!slot_handle<base>(to_handle(h.ptr())));
+
+		// stale handles are detected when the slot is reused
+		host::caller() = OPER(REF(2, 4));
+		slot_handle<base> h2(new base(2));
+		host::cell(2, 4) = h2.get();
+		host::caller() = OPER(REF(3, 4));
+		slot_handle<base> h3(new base(3));
+		ensure(h3.get() != x && (static_cast<uint64_t>(h3.get()) & 0x3ffffff) == (static_cast<uint64_t>(x) & 0x3ffffff));
+		host::caller() = OPER(REF(5, 5));
+		ensure(!slot_handle<base>(x));
+		ensure(slot_handle<base>(h3.get())->x == 3);
+
+		int n = 0;
+		slot_handle<base>::for_each([&n](HANDLEX, const base* p) { n += p->x; });
+		ensure(n == 2 + 3);
+
+		// handles of other slot types do not match
+		struct other : base { };
+		host::caller() = OPER(REF(4, 4));
+		slot_handle<other> o(new other);
+		host::caller() = OPER(REF(5, 5));
+		ensure(o.get() != h3.get() && o.get() != x);
+		ensure(!slot_handle<base>(o.get()));
+		ensure(!slot_handle<other>(h3.get()));
+
+		// type names resolve through the table of each type
+		ensure(handle_typename.find(o.get()) == typeid(other).name());
+		ensure(handle_typename.find(h3.get()) == typeid(base).name());
+		ensure(!handle_typename.find(x));
+		ensure(!handle_typename.find(INVALID_HANDLEX));
+		ensure(!handle_typename.find(-1.));
+		retired::reclaim();
+	}
+	{
+		// encoded handles keep every bit, including type tags above 2^48
+		struct tagged : base { };
+		slot_tags += 100;
+		host::caller() = OPER(REF(4, 5));
+		slot_handle<tagged> h(new tagged);
+		ensure(h.get() >= 0x1p48);
+		slot_handle<tagged>::codec c("tagged[", "]");
+		const OPER s = c.encode(h.get());
+		ensure(s.val.str[0] == 7 + 16 + 1);
+		ensure(c.decode(s) == h.get());
+		ensure(c.decode(c.encode(0x1p52 + 1)) == 0x1p52 + 1);
+	}
+	{
+		// a slot is retired when its generation is exhausted
+		struct gen { };
+		handle_slots<gen> slots;
+		const auto insert = [&slots]() {
+			return slots.insert(owner<gen>(new gen, [](gen* p) { delete p; }), OPER());
+		};
+		const HANDLEX x = insert();
+		ensure(slots.erase(x));
+		for (int i = 1; i < 0x8000; ++i) {
+			const HANDLEX y = insert();
+			ensure(y != x && (static_cast<uint64_t>(y) & 0x3ffffff) == 1);
+			ensure(slots.erase(y));
+		}
+		const HANDLEX z = insert();
+		ensure((static_cast<uint64_t>(z) & 0x3ffffff) == 2);
+		ensure(!slots.contains(x) && slots.contains(z));
+		ensure(retired::reclaim() == 0x8000);
+	}
+	host::caller() = OPER(REF(0, 0));
+
+	return 0;
+}
+
+int fpx_test()
+{
+	{
+		FPX a(2, 3);
+		for (int i = 0; i < a.size(); ++i) {
+			a[i] = i;
+		}
+		a.transpose();
+		ensure(a(2, 1) == 5);
+		ensure(sum(a) == 15);
+		ensure(sum(column(a, 1)) == 3 + 4 + 5);
+	}
+	{
+		// tiled and cycle-following paths
+		for (auto [r, c] : { std::pair(3, 5), std::pair(20, 30), std::pair(70, 70), std::pair(129, 33) }) {
+			FPX a(r, c);
+			for (int32_t i = 0; i < a.size(); ++i) {
+				a[i] = i;
+			}
+			a.transpose();
+			ensure(a.rows() == c && a.columns() == r);
+			for (int32_t i = 0; i < r; ++i) {
+				for (int32_t j = 0; j < c; ++j) {
+					ensure(a(j, i) == i * c + j);
+				}
+			}
+		}
+	}
+	{
+		FPX a;
+		a.reserve(100);
+		ensure(a.capacity() == 100);
+		a.append(0);
+		const double* p = a.array();
+		for (int i = 1; i < 100; ++i) {
+			a.append(i);
+		}
+		ensure(a.array() == p);
+		ensure(reinterpret_cast<uintptr_t>(p) % 64 == 0);
+		ensure(a.size() == 100);
+		a.append(100);
+		ensure(a.capacity() >= 200);
+		ensure(reinterpret_cast<uintptr_t>(a.array()) % 64 == 0);
+		ensure(a[99] == 99);
+		ensure(a.rows() == 1 && a.columns() == 101);
+		ensure(a[100] == 100);
+
+		a.resize(101, 1);
+		a.vstack(a);
+		ensure(a.rows() == 202);
+		ensure(a[101] == 0 && a[201] == 100);
+	}
+	{
+		FPX a(2, 2);
+		for (int32_t i = 0; i < 4; ++i) {
+			a[i] = i;
+		}
+		a.hstack(a);
+		ensure(a.rows() == 2 && a.columns() == 4);
+		ensure(a(0, 2) == 0 && a(0, 3) == 1);
+		ensure(a(1, 0) == 2 && a(1, 3) == 3);
+		a.resize(1, 8);
+		a.resize(0, 0);
+		ensure(a.capacity() >= 8);
+	}
+	{
+		// every kernel level against plain loops
+		int level = fpx_simd(-1);
+		for (int l = 0; l <= level; ++l) {
+			ensure(fpx_simd(l) == l);
+			for (int32_t n : {0, 1, 3, 4, 7, 16, 33, 100}) {
+				FPX x(1, n), y(1, n);
+				double s = 0, d = 0, lo = INFINITY, hi = -INFINITY;
+				for (int32_t i = 0; i < n; ++i) {
+					x[i] = i % 7 - 3;
+					y[i] = 1 + i % 5;
+					s += x[i];
+					d += x[i] * y[i];
+					lo = (std::min)(lo, x[i]);
+					hi = (std::max)(hi, x[i]);
+				}
+				ensure(sum(x) == s);
+				ensure(dot(x, y) == d);
+				ensure(minimum(x) == lo);
+				ensure(maximum(x) == hi);
+
+				FPX z(y);
+				axpy(2, x, z);
+				for (int32_t i = 0; i < n; ++i) {
+					ensure(z[i] == y[i] + 2 * x[i]);
+				}
+				FPX w(y);
+				mul(w, y);
+				div(w, y);
+				add(w, y);
+				sub(w, y);
+				scale(2, y);
+				cumsum(y);
+				s = 0;
+				for (int32_t i = 0; i < n; ++i) {
+					s += 2 * (1 + i % 5);
+					ensure(y[i] == s);
+				}
+			}
+		}
+		fpx_simd(level);
+
+		FPX a(2, 3);
+		for (int32_t i = 0; i < 6; ++i) {
+			a[i] = i;
+		}
+		auto r = row_sums(a);
+		ensure(r.rows() == 2 && r.columns() == 1);
+		ensure(r[0] == 3 && r[1] == 12);
+		auto c = column_sums(a);
+		ensure(c.rows() == 1 && c.columns() == 3);
+		ensure(c[0] == 3 && c[1] == 5 && c[2] == 7);
+	}
+	{
+		FPX a(3, 4);
+		for (int32_t i = 0; i < a.size(); ++i) {
+			a[i] = i;
+		}
+		auto c = column(a, 1);
+		ensure(c.rows() == 3 && c.columns() == 1);
+		ensure(c(0, 0) == 1 && c(1, 0) == 5 && c(2, 0) == 9);
+		ensure(sum(c) == 15);
+		c[2] = -9;
+		ensure(a(2, 1) == -9);
+		c[2] = 9;
+
+		auto b = block(a, 1, 1, 2, 3);
+		ensure(b.rows() == 2 && b.columns() == 3);
+		ensure(b(0, 0) == 5 && b(1, 2) == 11);
+		ensure(sum(b) == 5 + 6 + 7 + 9 + 10 + 11);
+
+		auto t = view(a).transpose();
+		ensure(t.rows() == 4 && t.columns() == 3);
+		ensure(t(1, 2) == a(2, 1));
+		ensure(sum(t.row(1)) == 15);
+		double s = 0;
+		for (double x : t.column(2)) {
+			s += x;
+		}
+		ensure(s == 8 + 9 + 10 + 11);
+		ensure(std::equal(t.row(3).begin(), t.row(3).end(), column(a, 3).begin()));
+	}
+
+	return 0;
+}
+
+int main()
+{
+	host::install();
+
+	int failed = 0;
+	using test_t = std::pair<const char*, int(*)()>;
+	for (auto [name, test] : {
+		test_t("utf8", utf8::test),
+		test_t("oper", oper_test),
+		test_t("arena", arena_test),
+		test_t("result", result_test),
+		test_t("excel", excel_test),
+		test_t("batch", batch_test),
+		test_t("suspend", suspend_test),
+		test_t("enum", enum_test),
+		test_t("addin", addin_test),
+		test_t("handle", handle_test),
+		test_t("fpx", fpx_test),
+		}) {
+		try {
+			test();
+		}
+		catch (const std::exception& ex) {
+			fprintf(stderr, "%s_test failed: %s\n", name, ex.what());
+			++failed;
+		}
+	}
+
+	return failed;
+}
@@ -135,7 +135,7 @@ AddIn xai_derived_get(
 LPOPER WINAPI xll_derived_get(HANDLEX _h)
 {
 #pragma XLLEXPORT
-	static OPER o;
+	XLL_RESULT(o);
 	// get handle to base class
 	xll::handle<base<OPER>> h(_h);
 
@@ -199,6 +199,7 @@ AddIn xai_id(
 	.Arguments({
 		Arg(XLL_LPOPER, L"ref", L"is a reference to a cell."),
 		})
+	.ThreadSafe()
 );
 LPOPER WINAPI xll_id(LPOPER pref)
 {
@@ -515,6 +516,28 @@ int multi_test()
 		OPER p = compress(o);
 		OPER q = expand(p);
 		ensure(o == q);
+		{
+			OPER p_(p); // copies do not own nested handles
+		}
+		ensure(o == expand(p));
+		OPER h(p[0]);
+		h = OPER(); // destroying a number does not free nested handles
+		ensure(o == expand(p));
+	}
+	{
+		// long strings of a copied range live in the multi
+		OPER o = Excel(xlfEvaluate, L"{1, \"a longer string\"; \"\", TRUE}");
+		ensure(storage(o[1]) == str_storage::pool);
+		ensure(storage(o[2]) == str_storage::local);
+		OPER s = std::move(o[1]);
+		ensure(s == L"a longer string");
+		ensure(storage(s) == str_storage::heap);
+		o[2] = OPER(L"de");
+		ensure(storage(o[2]) == str_storage::local);
+		OPER o2(o);
+		ensure(o2 == o);
+		std::swap(o2[1], o2[2]);
+		ensure(o2[1] == L"de");
 	}
 	{
 		OPER o({ OPER(1.23), OPER(L"abc"), OPER(true) });
@@ -561,6 +584,54 @@ int multi_test()
 		o.append(OPER());
 		ensure(o == OPER({ OPER(1),OPER(2), OPER() }));
 	}
+	{
+		OPER o;
+		o.reserve(10);
+		ensure(o.capacity() == 10);
+		ensure(size(o) == 0);
+		for (int i = 0; i < 100; ++i) {
+			o.append(OPER(i));
+		}
+		ensure(rows(o) == 1);
+		ensure(columns(o) == 100);
+		ensure(o.capacity() >= 100);
+		ensure(o[99] == 99);
+		o.append(o[0]);
+		ensure(o[100] == 0);
+	}
+	{
+		OPER o;
+		for (int i = 0; i < 100; ++i) {
+			o.vstack(OPER(i));
+		}
+		ensure(rows(o) == 100);
+		ensure(columns(o) == 1);
+		ensure(o[99] == 99);
+	}
+	{
+		OPER o({ OPER(1), OPER(L"a"), OPER(true), OPER(2), OPER(L"b"), OPER(false) });
+		o.reshape(2, 3);
+		OPER t(o);
+		t.transpose();
+		ensure(rows(t) == 3);
+		ensure(columns(t) == 2);
+		for (int i = 0; i < rows(o); ++i) {
+			for (int j = 0; j < columns(o); ++j) {
+				ensure(t(j, i) == o(i, j));
+			}
+		}
+		ensure(t == Excel(xlfTranspose, o));
+
+		OPER h(o);
+		h.hstack(t.transpose());
+		ensure(rows(h) == 2);
+		ensure(columns(h) == 6);
+		ensure(h(1, 2) == false);
+		ensure(h(1, 3) == 2);
+		ensure(h(1, 5) == false);
+		h.hstack(OPER(3, 1));
+		ensure(h == ErrValue);
+	}
 	{
 		OPER o{ OPER(1),OPER(L"a"), OPER(true) };
 		ensure(o);
@@ -766,11 +837,145 @@ int fp_test()
 		a.resize(2, 3);
 		ensure(a(0,2) == 3);
 		ensure(a(1,0) == 4);
-		/*
 		a.transpose();
+		ensure(a.rows() == 3);
 		ensure(a(2, 0) == 3);
 		ensure(a(0, 1) == 4);
-		*/
+	}
+	{
+		// tiled and cycle-following paths
+		for (auto [r, c] : { std::pair(3, 5), std::pair(20, 30), std::pair(70, 70), std::pair(129, 33) }) {
+			FPX a(r, c);
+			for (int32_t i = 0; i < a.size(); ++i) {
+				a[i] = i;
+			}
+			a.transpose();
+			ensure(a.rows() == c && a.columns() == r);
+			for (int32_t i = 0; i < r; ++i) {
+				for (int32_t j = 0; j < c; ++j) {
+					ensure(a(j, i) == i * c + j);
+				}
+			}
+		}
+	}
+	{
+		FPX a;
+		a.reserve(100);
+		ensure(a.capacity() == 100);
+		a.append(0);
+		const double* p = a.array();
+		for (int i = 1; i < 100; ++i) {
+			a.append(i);
+		}
+		ensure(a.array() == p);
+		ensure(reinterpret_cast<uintptr_t>(p) % 64 == 0);
+		ensure(a.size() == 100);
+		a.append(100);
+		ensure(a.capacity() >= 200);
+		ensure(reinterpret_cast<uintptr_t>(a.array()) % 64 == 0);
+		ensure(a[99] == 99);
+		ensure(a.rows() == 1 && a.columns() == 101);
+		ensure(a[100] == 100);
+
+		a.resize(101, 1);
+		a.vstack(a);
+		ensure(a.rows() == 202);
+		ensure(a[101] == 0 && a[201] == 100);
+	}
+	{
+		FPX a(2, 2);
+		for (int32_t i = 0; i < 4; ++i) {
+			a[i] = i;
+		}
+		a.hstack(a);
+		ensure(a.rows() == 2 && a.columns() == 4);
+		ensure(a(0, 2) == 0 && a(0, 3) == 1);
+		ensure(a(1, 0) == 2 && a(1, 3) == 3);
+		a.resize(1, 8);
+		a.resize(0, 0);
+		ensure(a.capacity() >= 8);
+	}
+	{
+		// every kernel level against plain loops
+		int level = fpx_simd(-1);
+		for (int l = 0; l <= level; ++l) {
+			ensure(fpx_simd(l) == l);
+			for (int32_t n : {0, 1, 3, 4, 7, 16, 33, 100}) {
+				FPX x(1, n), y(1, n);
+				double s = 0, d = 0, lo = INFINITY, hi = -INFINITY;
+				for (int32_t i = 0; i < n; ++i) {
+					x[i] = i % 7 - 3;
+					y[i] = 1 + i % 5;
+					s += x[i];
+					d += x[i] * y[i];
+					lo = (std::min)(lo, x[i]);
+					hi = (std::max)(hi, x[i]);
+				}
+				ensure(sum(x) == s);
+				ensure(dot(x, y) == d);
+				ensure(minimum(x) == lo);
+				ensure(maximum(x) == hi);
+
+				FPX z(y);
+				axpy(2, x, z);
+				for (int32_t i = 0; i < n; ++i) {
+					ensure(z[i] == y[i] + 2 * x[i]);
+				}
+				FPX w(y);
+				mul(w, y);
+				div(w, y);
+				add(w, y);
+				sub(w, y);
+				scale(2, y);
+				cumsum(y);
+				s = 0;
+				for (int32_t i = 0; i < n; ++i) {
+					s += 2 * (1 + i % 5);
+					ensure(y[i] == s);
+				}
+			}
+		}
+		fpx_simd(level);
+
+		FPX a(2, 3);
+		for (int32_t i = 0; i < 6; ++i) {
+			a[i] = i;
+		}
+		auto r = row_sums(a);
+		ensure(r.rows() == 2 && r.columns() == 1);
+		ensure(r[0] == 3 && r[1] == 12);
+		auto c = column_sums(a);
+		ensure(c.rows() == 1 && c.columns() == 3);
+		ensure(c[0] == 3 && c[1] == 5 && c[2] == 7);
+	}
+	{
+		FPX a(3, 4);
+		for (int32_t i = 0; i < a.size(); ++i) {
+			a[i] = i;
+		}
+		auto c = column(a, 1);
+		ensure(c.rows() == 3 && c.columns() == 1);
+		ensure(c(0, 0) == 1 && c(1, 0) == 5 && c(2, 0) == 9);
+		ensure(sum(c) == 15);
+		c[2] = -9;
+		ensure(a(2, 1) == -9);
+		c[2] = 9;
+
+		auto b = block(a, 1, 1, 2, 3);
+		ensure(b.rows() == 2 && b.columns() == 3);
+		ensure(b(0, 0) == 5 && b(1, 2) == 11);
+		ensure(sum(b) == 5 + 6 + 7 + 9 + 10 + 11);
+
+		auto t = view(a).transpose();
+		ensure(t.rows() == 4 && t.columns() == 3);
+		ensure(t(1, 2) == a(2, 1));
+		ensure(sum(t.row(1)) == 15);
+		double s = 0;
+		for (double x : t.column(2)) {
+			s += x;
+		}
+		ensure(s == 8 + 9 + 10 + 11);
+		ensure(std::equal(t.row(3).begin(), t.row(3).end(), column(a, 3).begin()));
 	}
 
 	return 0;
@@ -904,7 +1109,7 @@ AddIn xai_relref(
 LPOPER WINAPI xll_relref(LPXLOPER12 pref, LPXLOPER12 prel)
 {
 #pragma XLLEXPORT
-	static OPER o;
+	XLL_RESULT(o);
 
 	try {
 		ensure(isSRef(*pref) || isRef(*pref));
@@ -931,7 +1136,7 @@ AddIn xai_accumulate(
 double WINAPI xll_accumulate(_FP12* pa)
 {
 #pragma XLLEXPORT
-	return std::accumulate(span(*pa).begin(), span(*pa).end(), 0.);
+	return sum(*pa);
 }
 
 AddIn xai_get_workspace(
@@ -947,7 +1152,7 @@ AddIn xai_get_workspace(
 LPOPER WINAPI xll_get_workspace(LPOPER po)
 {
 #pragma XLLEXPORT
-	static OPER o;
+	XLL_RESULT(o);
 	
 	o = Excel(xlfGetWorkspace, *po);
 
@@ -967,7 +1172,7 @@ AddIn xai_get_workbook(
 LPOPER WINAPI xll_get_workbook(LPOPER po)
 {
 #pragma XLLEXPORT
-	static OPER o;
+	XLL_RESULT(o);
 
 	o = Excel(xlfGetWorkbook, *po);
 
@@ -986,7 +1191,7 @@ AddIn xai_evaluate(
 LPOPER WINAPI xll_evaluate(LPOPER po)
 {
 #pragma XLLEXPORT
-	static OPER o;
+	XLL_RESULT(o);
 
 	o = Excel(xlfEvaluate, *po);
 